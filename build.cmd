@@ -32,4 +32,9 @@ set cmd=cl %opts% %includes% %srcfiles% /link /LIBPATH:lib /NODEFAULTLIB:MSVCRT
 echo %cmd%
 %cmd%
 
+echo Compiling font pack tool
+set cmd=cl %opts% %includes% %dirsrc%\tools\font_pack.c /link /OUT:bin\font_pack.exe
+echo %cmd%
+%cmd%
+
 popd
@@ -5,8 +5,12 @@ mkdir bin
 cd src
 
 gcc main.c \
-    -lglfw -lGLU -lGLEW -lGL -lm \
+    -lglfw -lGLU -lGLEW -lGL -lEGL -lm \
     -o ../bin/cgui
 
+# builds src/fonts/atlas.fontpack from the png and csv, run from the root
+gcc tools/font_pack.c -lm \
+    -o ../bin/font_pack
+
     # build release
     #-lglfw -lGLU -lGLEW -lGL -lm -O2 \
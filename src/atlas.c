@@ -0,0 +1,338 @@
+//
+// Texture Atlas
+//
+// Every texture draw.c samples from lives in the pages of a single
+// GL_TEXTURE_2D_ARRAY, so glyphs, icons and images can all be drawn in the
+// same instanced draw call. Each instance stores the page (layer) it samples.
+// Images are packed into the pages with a shelf packer. Freed regions are
+// handed out again to anything that fits them, a page without any regions
+// left starts over empty. Every region has a border of padding around it
+// that uploads fill with its edge pixels, so linear filtering at the edges
+// never picks up a neighbour or what a freed region left behind.
+//
+// API:
+//
+// bool atlas_init();
+// void atlas_deinit();
+// bool atlas_alloc(int w, int h, AtlasRegion* region);
+// bool atlas_try_alloc(int w, int h, AtlasRegion* region); // doesn't warn when full
+// void atlas_free(AtlasRegion* region);
+// void atlas_upload(AtlasRegion* region, U8* rgba);
+// void atlas_upload_rect(AtlasRegion* region, int x, int y, int w, int h, U8* rgba, int row_length);
+// bool atlas_add_image(const char* image_path, AtlasRegion* region);
+//
+
+#define ATLAS_PAGE_SIZE   1024
+#define ATLAS_PAGE_COUNT  4
+#define ATLAS_PADDING     1 // px on each side of a region, a copy of its edge pixels
+#define ATLAS_MAX_SHELVES 64
+#define ATLAS_MAX_FREED   64 // per page, space freed beyond that is only reclaimed once the page is empty
+
+typedef struct
+{
+    int layer;
+    int x,y,w,h;       // px within the page
+    float u0,v0,u1,v1; // normalized within the page
+} AtlasRegion;
+
+typedef struct
+{
+    int x; // next free x
+    int y;
+    int h;
+} AtlasShelf;
+
+// freed area, padding included
+typedef struct
+{
+    int x,y,w,h;
+} AtlasFreeRect;
+
+typedef struct
+{
+    AtlasShelf shelves[ATLAS_MAX_SHELVES];
+    int shelf_count;
+    int next_y; // top of the unused space below the last shelf
+
+    AtlasFreeRect freed[ATLAS_MAX_FREED];
+    int freed_count;
+    int region_count; // allocated and not freed
+} AtlasPage;
+
+static struct
+{
+    GLuint texture;
+    AtlasPage pages[ATLAS_PAGE_COUNT];
+    U32 generation; // bumped on every upload
+} atlas = {0};
+
+bool atlas_init()
+{
+    memset(atlas.pages, 0, sizeof(atlas.pages));
+    atlas.generation = 0;
+
+    glGenTextures(1, &atlas.texture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, atlas.texture);
+
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, ATLAS_PAGE_COUNT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    logi("Atlas: %d pages of %dx%d", ATLAS_PAGE_COUNT, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE);
+
+    return true;
+}
+
+void atlas_deinit()
+{
+    glDeleteTextures(1, &atlas.texture);
+    atlas.texture = 0;
+}
+
+static void atlas_page_add_freed(AtlasPage* page, int x, int y, int w, int h)
+{
+    if(w <= 0 || h <= 0 || page->freed_count == ATLAS_MAX_FREED)
+        return;
+
+    AtlasFreeRect* rect = &page->freed[page->freed_count++];
+    rect->x = x;
+    rect->y = y;
+    rect->w = w;
+    rect->h = h;
+}
+
+// smallest freed rect that fits, the rest of it is split off to the
+// right and below
+static bool atlas_page_alloc_freed(AtlasPage* page, int w, int h, int* x, int* y)
+{
+    int best = -1;
+
+    for(int i = 0; i < page->freed_count; ++i)
+    {
+        AtlasFreeRect* rect = &page->freed[i];
+
+        if(rect->w < w || rect->h < h)
+            continue;
+
+        if(best < 0 || rect->w*rect->h < page->freed[best].w*page->freed[best].h)
+            best = i;
+    }
+
+    if(best < 0)
+        return false;
+
+    AtlasFreeRect rect = page->freed[best];
+    page->freed[best] = page->freed[--page->freed_count];
+
+    *x = rect.x;
+    *y = rect.y;
+
+    atlas_page_add_freed(page, rect.x + w, rect.y, rect.w - w, h);
+    atlas_page_add_freed(page, rect.x, rect.y + h, rect.w, rect.h - h);
+    return true;
+}
+
+static bool atlas_page_alloc(AtlasPage* page, int w, int h, int* x, int* y)
+{
+    if(atlas_page_alloc_freed(page, w, h, x, y))
+        return true;
+
+    // best fitting shelf that still has room
+    AtlasShelf* best = NULL;
+
+    for(int i = 0; i < page->shelf_count; ++i)
+    {
+        AtlasShelf* shelf = &page->shelves[i];
+
+        if(shelf->h < h || shelf->x + w > ATLAS_PAGE_SIZE)
+            continue;
+
+        if(!best || shelf->h < best->h)
+            best = shelf;
+    }
+
+    // don't waste a tall shelf on something much shorter if a new shelf fits
+    bool can_add_shelf = (page->shelf_count < ATLAS_MAX_SHELVES && page->next_y + h <= ATLAS_PAGE_SIZE);
+
+    if(best && (best->h <= 2*h || !can_add_shelf))
+    {
+        *x = best->x;
+        *y = best->y;
+        best->x += w;
+        return true;
+    }
+
+    if(!can_add_shelf)
+        return false;
+
+    AtlasShelf* shelf = &page->shelves[page->shelf_count++];
+    shelf->x = w;
+    shelf->y = page->next_y;
+    shelf->h = h;
+
+    page->next_y += h;
+
+    *x = 0;
+    *y = shelf->y;
+    return true;
+}
+
+// reserves a w x h area in one of the pages
+bool atlas_try_alloc(int w, int h, AtlasRegion* region)
+{
+    int pw = w + 2*ATLAS_PADDING;
+    int ph = h + 2*ATLAS_PADDING;
+
+    if(pw > ATLAS_PAGE_SIZE || ph > ATLAS_PAGE_SIZE)
+    {
+        logw("Region too large for the atlas (%d x %d)", w, h);
+        return false;
+    }
+
+    for(int layer = 0; layer < ATLAS_PAGE_COUNT; ++layer)
+    {
+        int x, y;
+        if(!atlas_page_alloc(&atlas.pages[layer], pw, ph, &x, &y))
+            continue;
+
+        region->layer = layer;
+        region->x = x + ATLAS_PADDING;
+        region->y = y + ATLAS_PADDING;
+        region->w = w;
+        region->h = h;
+
+        region->u0 = region->x / (float)ATLAS_PAGE_SIZE;
+        region->v0 = region->y / (float)ATLAS_PAGE_SIZE;
+        region->u1 = (region->x + w) / (float)ATLAS_PAGE_SIZE;
+        region->v1 = (region->y + h) / (float)ATLAS_PAGE_SIZE;
+
+        atlas.pages[layer].region_count++;
+
+        return true;
+    }
+
+    return false;
+}
+
+bool atlas_alloc(int w, int h, AtlasRegion* region)
+{
+    if(atlas_try_alloc(w, h, region))
+        return true;
+
+    if(w + 2*ATLAS_PADDING <= ATLAS_PAGE_SIZE && h + 2*ATLAS_PADDING <= ATLAS_PAGE_SIZE)
+        logw("Atlas is full, failed to allocate %d x %d", w, h);
+    return false;
+}
+
+// gives the area of an allocated region back to its page
+void atlas_free(AtlasRegion* region)
+{
+    AtlasPage* page = &atlas.pages[region->layer];
+
+    if(--page->region_count <= 0)
+        memset(page, 0, sizeof(AtlasPage));
+    else
+        atlas_page_add_freed(page, region->x - ATLAS_PADDING, region->y - ATLAS_PADDING, region->w + 2*ATLAS_PADDING, region->h + 2*ATLAS_PADDING);
+
+    memset(region, 0, sizeof(AtlasRegion));
+}
+
+// a row of w px at (x,y) in layer z, widened into the left and right
+// padding by repeating its end pixels if those are set
+static void atlas_upload_padding_row(int x, int y, int z, int w, bool left, bool right, U8* row)
+{
+    GL_CALL(glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x, y, z, w, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, row));
+
+    for(int i = 1; i <= ATLAS_PADDING; ++i)
+    {
+        if(left)
+            GL_CALL(glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x - i, y, z, 1, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, row));
+        if(right)
+            GL_CALL(glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x + w - 1 + i, y, z, 1, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, row + 4*(w-1)));
+    }
+}
+
+// uploads a w x h part at (x,y) within the region. rows of rgba are
+// row_length px apart, so the part can be taken out of a larger image.
+// With a GL_PIXEL_UNPACK_BUFFER bound rgba is an offset into it.
+// Parts on the edge of the region also fill the padding next to it
+void atlas_upload_rect(AtlasRegion* region, int x, int y, int w, int h, U8* rgba, int row_length)
+{
+    GL_CALL(glBindTexture(GL_TEXTURE_2D_ARRAY, atlas.texture));
+    GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+    GL_CALL(glPixelStorei(GL_UNPACK_ROW_LENGTH, row_length));
+
+    int x0 = region->x + x;
+    int y0 = region->y + y;
+    int z = region->layer;
+
+    GL_CALL(glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x0, y0, z, w, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, rgba));
+
+    // edge pixels are repeated into the padding, one row or column at a
+    // time. The corners come along with the top and bottom rows
+    bool left   = (x == 0);
+    bool right  = (x + w == region->w);
+    bool top    = (y == 0);
+    bool bottom = (y + h == region->h);
+
+    U8* first_row = rgba;
+    U8* last_row = rgba + 4*(size_t)row_length*(h-1);
+
+    for(int i = 1; i <= ATLAS_PADDING; ++i)
+    {
+        if(left)
+            GL_CALL(glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x0 - i, y0, z, 1, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, rgba));
+        if(right)
+            GL_CALL(glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x0 + w - 1 + i, y0, z, 1, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, rgba + 4*(w-1)));
+    }
+
+    for(int i = 1; i <= ATLAS_PADDING; ++i)
+    {
+        if(top)
+            atlas_upload_padding_row(x0, y0 - i, z, w, left, right, first_row);
+        if(bottom)
+            atlas_upload_padding_row(x0, y0 + h - 1 + i, z, w, left, right, last_row);
+    }
+
+    GL_CALL(glPixelStorei(GL_UNPACK_ROW_LENGTH, 0));
+    GL_CALL(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+    GL_CALL(glBindTexture(GL_TEXTURE_2D_ARRAY, 0));
+
+    atlas.generation++;
+}
+
+// uploads w*h RGBA8 pixels into the region
+void atlas_upload(AtlasRegion* region, U8* rgba)
+{
+    atlas_upload_rect(region, 0, 0, region->w, region->h, rgba, region->w);
+}
+
+bool atlas_add_image(const char* image_path, AtlasRegion* region)
+{
+    int w, h, n;
+
+    stbi_set_flip_vertically_on_load(false);
+    U8* data = stbi_load(image_path, &w, &h, &n, 4);
+
+    if(!data)
+    {
+        loge("Failed to load image: %s", image_path);
+        return false;
+    }
+
+    bool allocated = atlas_alloc(w, h, region);
+    if(allocated)
+    {
+        atlas_upload(region, data);
+        logi("Added image to atlas: %s (w: %d, h: %d, layer: %d)", image_path, w, h, region->layer);
+    }
+
+    stbi_image_free(data);
+    return allocated;
+}
@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdarg.h>
@@ -31,12 +32,22 @@
 #include <sys/time.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <sys/resource.h> // for getrusage
+#include <sys/mman.h>
+#include <fcntl.h>
 #include <pthread.h>
 #endif
 
 #include <assert.h>
 #include <float.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 //:==================================
 // Types
 //:==================================
@@ -56,12 +67,32 @@ typedef int16_t   B16;
 typedef int32_t   B32;
 typedef int64_t   B64;
 
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+// _Static_assert, msvc only knows it when building as c11
+#if defined(_MSC_VER) && !defined(__STDC_VERSION__)
+#define STATIC_ASSERT_NAME2(line) static_assert_##line
+#define STATIC_ASSERT_NAME(line) STATIC_ASSERT_NAME2(line)
+#define STATIC_ASSERT(cond, msg) typedef char STATIC_ASSERT_NAME(__LINE__)[(cond) ? 1 : -1]
+#else
+#define STATIC_ASSERT(cond, msg) _Static_assert(cond, msg)
+#endif
+
 //:==================================
 // Debugging
 //:==================================
 
 #define DEBUG()   printf("[DEBUG] %s %s(): %d\n", __FILE__, __func__, __LINE__)
 
+// gl calls issued since draw_commit() last took the count, for the hud.
+// Calls are counted where they're made: GL_CALL(glBindTexture(...))
+static int gl_call_count = 0;
+#define GL_CALL(call) (gl_call_count++, (call))
+
 //:==================================
 // Math
 //:==================================
@@ -203,6 +234,7 @@ void* arena_alloc(Arena* arena, size_t size)
         a->next->base = (U8*)malloc(new_arena_size * sizeof(U8));
         a->next->offset = 0;
         a->next->capacity = new_arena_size;
+        a->next->next = NULL;
     }
 
     void* ptr = a->base+a->offset;
@@ -255,12 +287,12 @@ B32 StringEndsWith(String str, String suffix) {
     return (strncmp(str.data + (str.len - suffix.len), suffix.data, suffix.len) == 0);
 }
 
-String StringFormat(Arena* arena, const char* format, ...)
+String StringFormatV(Arena* arena, const char* format, va_list args)
 {
-    va_list args;
-    va_start(args, format);
-    int required_len = vsnprintf(NULL, 0, format, args);
-    va_end(args);
+    va_list args_copy;
+    va_copy(args_copy, args);
+    int required_len = vsnprintf(NULL, 0, format, args_copy);
+    va_end(args_copy);
 
     if (required_len < 0)
     {
@@ -274,13 +306,92 @@ String StringFormat(Arena* arena, const char* format, ...)
         return (String){ .len = 0, .data = NULL };
     }
 
-    va_start(args, format);
     vsnprintf(buffer, required_len + 1, format, args);
-    va_end(args);
 
     return (String){ .len = (U32)required_len, .data = buffer };
 }
 
+String StringFormat(Arena* arena, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    String str = StringFormatV(arena, format, args);
+    va_end(args);
+
+    return str;
+}
+
+// decodes the code point at str[*i] and moves *i past it. invalid or
+// truncated sequences decode as U+FFFD and skip a single byte
+U32 utf8_decode(const char* str, int len, int* i)
+{
+    const U8* s = (const U8*)str;
+    U32 c = s[*i];
+
+    if(c < 0x80)
+    {
+        (*i)++;
+        return c;
+    }
+
+    int n;
+    U32 cp, min;
+    if((c & 0xE0) == 0xC0)      { n = 1; cp = c & 0x1F; min = 0x80; }
+    else if((c & 0xF0) == 0xE0) { n = 2; cp = c & 0x0F; min = 0x800; }
+    else if((c & 0xF8) == 0xF0) { n = 3; cp = c & 0x07; min = 0x10000; }
+    else
+    {
+        (*i)++;
+        return 0xFFFD;
+    }
+
+    if(*i + n >= len)
+    {
+        (*i)++;
+        return 0xFFFD;
+    }
+
+    for(int k = 1; k <= n; ++k)
+    {
+        U32 b = s[*i + k];
+        if((b & 0xC0) != 0x80)
+        {
+            (*i)++;
+            return 0xFFFD;
+        }
+        cp = (cp << 6) | (b & 0x3F);
+    }
+
+    // overlong, surrogate or out of range
+    if(cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+    {
+        (*i)++;
+        return 0xFFFD;
+    }
+
+    *i += n+1;
+    return cp;
+}
+
+// number of leading bytes of str below 0x80, 16 at a time with sse2
+int utf8_ascii_prefix(const char* str, int len)
+{
+    int i = 0;
+
+#if defined(__SSE2__)
+    for(; i+16 <= len; i += 16)
+    {
+        if(_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(str+i))))
+            break;
+    }
+#endif
+
+    while(i < len && !(str[i] & 0x80))
+        ++i;
+
+    return i;
+}
+
 int StringGetExtension(const char *source, char *buf, int buf_len)
 {
     if (!source || !buf) return 0;
@@ -306,6 +417,51 @@ int StringGetExtension(const char *source, char *buf, int buf_len)
     return 0;
 }
 
+//:==================================
+// Hashing
+//:==================================
+
+#define HASH_SEED 0x9E3779B97F4A7C15ull
+
+// avalanche step, use on the result of hash_bytes() when the
+// low bits are used directly (e.g. indexing a table)
+U64 hash_mix64(U64 h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// word at a time hash; pass the previous result in as 'h' to keep
+// hashing a stream that's spread over multiple buffers
+U64 hash_bytes(U64 h, const void* data, size_t len)
+{
+    const U8* p = (const U8*)data;
+
+    while(len >= 8)
+    {
+        U64 w;
+        memcpy(&w, p, 8);
+        h ^= w * 0x87c37b91114253d5ull;
+        h = ((h << 31) | (h >> 33)) * 0x4cf5ad432745937full;
+        p += 8;
+        len -= 8;
+    }
+
+    if(len > 0)
+    {
+        U64 w = 0;
+        memcpy(&w, p, len);
+        h ^= w * 0x87c37b91114253d5ull;
+        h = ((h << 31) | (h >> 33)) * 0x4cf5ad432745937full;
+    }
+
+    return h;
+}
+
 //:==================================
 // Arrays
 //:==================================
@@ -330,6 +486,75 @@ inline int FileWriteU32AtIndex(FILE* file, U32 x, U32 index) {
     return ret;
 }
 
+// read only view of a whole file, pages are loaded as they're touched
+typedef struct
+{
+    U8* data;
+    size_t size;
+#if PLATFORM == PLATFORM_WINDOWS
+    HANDLE file;
+    HANDLE mapping;
+#endif
+} FileMapping;
+
+void file_unmap(FileMapping* map)
+{
+#if PLATFORM == PLATFORM_WINDOWS
+    if(map->data) UnmapViewOfFile(map->data);
+    if(map->mapping) CloseHandle(map->mapping);
+    if(map->file && map->file != INVALID_HANDLE_VALUE) CloseHandle(map->file);
+#else
+    if(map->data) munmap(map->data, map->size);
+#endif
+    memset(map, 0, sizeof(FileMapping));
+}
+
+bool file_map(const char* path, FileMapping* map)
+{
+    memset(map, 0, sizeof(FileMapping));
+
+#if PLATFORM == PLATFORM_WINDOWS
+    map->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(map->file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(map->file, &size) || size.QuadPart == 0)
+    {
+        file_unmap(map);
+        return false;
+    }
+
+    map->size = (size_t)size.QuadPart;
+    map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(map->mapping)
+        map->data = (U8*)MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    struct stat st;
+    if(fstat(fd, &st) == 0 && st.st_size > 0)
+    {
+        map->size = (size_t)st.st_size;
+        void* data = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        map->data = (data == MAP_FAILED) ? NULL : (U8*)data;
+    }
+
+    // the mapping stays valid without the descriptor
+    close(fd);
+#endif
+
+    if(!map->data)
+    {
+        file_unmap(map);
+        return false;
+    }
+
+    return true;
+}
+
 //:==================================
 // Timer
 //:==================================
@@ -343,6 +568,13 @@ typedef struct
     double frame_fps;
     double frame_fps_hist[60];
     double frame_fps_avg;
+
+    // gpu time of the frame, reported late by the renderer (see timer_set_gpu_time)
+    double gpu_ms;
+    double gpu_ms_hist[60];
+    double gpu_ms_avg;
+    int gpu_ms_hist_count;
+    int gpu_ms_hist_max_count;
 } Timer;
 
 static struct
@@ -436,6 +668,10 @@ void timer_begin(Timer* timer)
     timer->time_last = timer->time_start;
     timer->frame_fps = 0.0f;
     timer->frame_fps_avg = 0.0f;
+    timer->gpu_ms = 0.0;
+    timer->gpu_ms_avg = 0.0;
+    timer->gpu_ms_hist_count = 0;
+    timer->gpu_ms_hist_max_count = 0;
 }
 
 double timer_get_time()
@@ -478,6 +714,26 @@ void timer_wait_for_frame(Timer* timer)
     timer->frame_fps_avg = (fps_sum / _fps_hist_max_count);
 }
 
+void timer_set_gpu_time(Timer* timer, double ms)
+{
+    timer->gpu_ms = ms;
+
+    // calculate average gpu time
+    timer->gpu_ms_hist[timer->gpu_ms_hist_count++] = ms;
+
+    if(timer->gpu_ms_hist_count >= 60)
+        timer->gpu_ms_hist_count = 0;
+
+    if(timer->gpu_ms_hist_max_count < 60)
+        timer->gpu_ms_hist_max_count++;
+
+    double ms_sum = 0.0;
+    for(int i = 0; i < timer->gpu_ms_hist_max_count; ++i)
+        ms_sum += timer->gpu_ms_hist[i];
+
+    timer->gpu_ms_avg = (ms_sum / timer->gpu_ms_hist_max_count);
+}
+
 double timer_get_elapsed(Timer* timer)
 {
     double time_curr = get_time();
@@ -511,15 +767,21 @@ const char* log_level_colors[] = {
   "\x1b[94m", "\x1b[36m", "\x1b[32m", "\x1b[33m", "\x1b[31m", "\x1b[35m"
 };
 
-va_list ap;
-
 void _log(LogLevel level, const char* file, int line, const char* fmt, ...)
 {
+    va_list ap;
+
+    // workers log too, localtime() shares its result between threads
     time_t t = time(NULL);
-    struct tm* _time = localtime(&t);
+    struct tm _time;
+#if PLATFORM == PLATFORM_WINDOWS
+    localtime_s(&_time, &t);
+#else
+    localtime_r(&t, &_time);
+#endif
 
     char time_str[10] = {0};
-    strftime(time_str, sizeof(time_str), "%H:%M:%S", _time);
+    strftime(time_str, sizeof(time_str), "%H:%M:%S", &_time);
 
     va_start(ap, fmt);
     fprintf(stdout, "%s %s%-5s\x1b[0m \x1b[90m%s:%-4d:\x1b[0m ", time_str, log_level_colors[level], log_level_strings[level], file, line);
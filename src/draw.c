@@ -2,6 +2,7 @@
 //
 // API:
 //
+// void draw_start_loading(); // decodes the fonts on worker threads until draw_init() needs them, needs no GL
 // void draw_clear_screen(float r, float g, float b);
 // void draw_rect(float x, float y, float w, float h, Vec4f color);
 // void draw_rect_frame(float x, float y, float w, float h, Vec4f color, float border_thickness);
@@ -9,11 +10,55 @@
 // void draw_rect_hgrad(float x, float y, float w, float h, Vec4f color1, Vec4f color2);
 // void draw_set_rect_corner_radius(float r);
 // void draw_set_rect_edge_softness(float v);
+// void draw_set_split_rects(bool split); // large opaque rounded rects draw their interior without the sdf, on by default
+// void draw_push_clip(float x, float y, float w, float h); // intersects with the current clip rect
+// void draw_pop_clip();
+// void draw_set_layer(U8 layer); // see DrawLayer, drawn on top of lower layers
+// U8   draw_get_layer();
+// void draw_set_z(U16 z); // order within a layer
+// void draw_set_regroup(bool regroup); // allows batching by pipeline and texture within the same layer and z
 // void draw_string(float x, float y, float scale, Vec4f color, char* format, ...);
-// void draw_commit(); // needs to be called at the end of frame
+// void draw_text(float x, float y, float scale, Vec4f color, String s); // no formatting, no length limit
+// Vec2f string_get_size(float scale, char* fmt, ...);
+// Vec2f text_get_size(float scale, String s);
+// void string_get_sizes(float scale, String* strings, int count, Vec2f* sizes);
+// void draw_image(float x, float y, float w, float h, AtlasRegion* image, Vec4f tint);
+// void draw_line(float x0, float y0, float x1, float y1, float thickness, Vec4f color);
+// void draw_polyline(Vec2f* points, int count, float thickness, Vec4f color); // round joins, translucent ones overlap there
+// void draw_set_line_cap(DrawLineCap cap);
+// void draw_circle(float cx, float cy, float radius, Vec4f color);
+// void draw_ring(float cx, float cy, float radius, float thickness, Vec4f color); // thickness inside the radius
+// bool draw_commit(); // needs to be called at the end of frame, returns false if the frame was skipped
+// void draw_invalidate(); // forces the next commit to draw even if nothing changed
+// DrawStats draw_get_stats();
+// bool draw_take_gpu_time(double* ms); // true if a new gpu time of a commit came in
 //
+// DrawList* draw_list_create(); // per thread recording, see DrawList
+// void draw_list_destroy(DrawList* list);
+// void draw_set_list(DrawList* list); // list the calling thread draws into, NULL for the main list
+//
+
+#define DRAW_CHUNK_RECTS 1024
+#define DRAW_RING_SEGMENTS 3
+#define DRAW_ATTRIB_COUNT 8
+#define DRAW_CULL_TILE_SIZE 32 // px
+#define DRAW_CLIP_STACK_MAX 32
+#define DRAW_MAX_LISTS 64
+#define DRAW_SORT_REGROUP 1
+#define DRAW_GPU_QUERIES 4 // commits a gpu time may lag behind
+#define DRAW_SPLIT_MIN_SIZE 64 // px, smallest interior worth splitting a rect for
+#define DRAW_MAX_DEPTH 65535 // instances a frame can have for the opaque depth pass
+#define DRAW_SPECIALIZE_MIN 32 // instances a run needs to keep its own program, shorter ones share the generic one
+
+#define GLYPH_CACHE_BUCKETS   1024 // power of 2
+#define GLYPH_CACHE_MAX_BYTES (4*1024*1024)
+
+#define MEASURE_CACHE_SIZE 512 // power of 2
 
-#define MAX_RECTS 1024
+// quantization of the instance fields, needs to match basic.vert.glsl
+#define DRAW_POS_SCALE      8.0f  // 1/8th px steps, covers -4096 to +4096
+#define DRAW_SOFTNESS_SCALE 16.0f // 1/16th px steps, up to ~16 px
+#define DRAW_BORDER_SCALE   4.0f  // 1/4th px steps, up to ~64 px for rect borders, ~16k px for shapes
 
 #define WHITE   color(1.0,1.0,1.0)
 #define BLACK   color(0.0,0.0,0.0)
@@ -25,8 +70,22 @@
 #define YELLOW  color(1.0,1.0,0.0)
 #define CYAN    color(0.0,1.0,1.0)
 
-#define FONT_PATH_IMAGE  "src/fonts/atlas.png"
-#define FONT_PATH_LAYOUT "src/fonts/atlas_layout.csv"
+#define FONT_PATH_PACK    "src/fonts/atlas.fontpack" // see font_pack.c, the png and csv files are the fallback
+#define FONT_PATH_IMAGE   "src/fonts/atlas.png"
+#define FONT_PATH_LAYOUT  "src/fonts/atlas_layout.csv"
+#define FONT_PATH_KERNING "src/fonts/atlas_kerning.csv" // optional, "left,right,adjust" with code points and em
+
+// runtime glyphs, for everything outside the baked ascii atlas
+#define FONT_CACHE_W     960  // px of the atlas reserved for them
+#define FONT_CACHE_H     512
+#define FONT_CELL_SIZE   64   // px, one glyph per cell
+#define FONT_CELL_COUNT  ((FONT_CACHE_W/FONT_CELL_SIZE)*(FONT_CACHE_H/FONT_CELL_SIZE))
+#define FONT_PX_PER_EM   40   // size they're rasterized at, less if a glyph doesn't fit its cell
+#define FONT_SDF_RANGE   4.0f // px, needs to match screenPxRange() in basic.frag.glsl
+#define FONT_GLYPH_MAX   4096 // code points whose metrics are kept
+#define FONT_GLYPH_PAGE_BITS 8
+#define FONT_GLYPH_PAGE_SIZE (1 << FONT_GLYPH_PAGE_BITS)
+#define FONT_GLYPH_PAGE_COUNT (0x110000 >> FONT_GLYPH_PAGE_BITS)
 
 static GLuint vao;
 static GLuint vbo;
@@ -41,52 +100,364 @@ typedef struct
     float x,y,z,w;
 } Vec4f;
 
+// Instances are drawn sorted by layer, then z, then call order. Layers let
+// overlays be issued at any point of the frame and still end up on top.
+typedef enum
+{
+    DRAW_LAYER_DEFAULT = 0,
+    DRAW_LAYER_POPUP   = 128,
+    DRAW_LAYER_TOOLTIP = 192,
+    DRAW_LAYER_DEBUG   = 255, // e.g. the hud
+} DrawLayer;
+
+typedef enum
+{
+    DRAW_FLAG_GRADIENT_H = (1<<0), // color1 on the left, color2 on the right
+    DRAW_FLAG_GRADIENT_V = (1<<1), // color1 on the top, color2 on the bottom
+    DRAW_FLAG_TEXTURED   = (1<<2), // glyph, samples the msdf font from the atlas
+    DRAW_FLAG_IMAGE      = (1<<3), // samples the atlas, tinted by the color
+    DRAW_FLAG_LINE       = (1<<4), // segment between two corners, border_thickness is its thickness
+    DRAW_FLAG_CIRCLE     = (1<<5), // fills the quad, a ring of border_thickness if that's set
+    DRAW_FLAG_LINE_FLIP  = (1<<6), // line from the top right to the bottom left corner
+    DRAW_FLAG_LINE_BUTT  = (1<<7), // flat line caps at the end points
+} DrawRectFlag;
+
+typedef enum
+{
+    DRAW_LINE_CAP_ROUND,
+    DRAW_LINE_CAP_BUTT,   // ends at the end points
+    DRAW_LINE_CAP_SQUARE, // extends past them by half the thickness
+} DrawLineCap;
+
+// packed instance data, 40 bytes
 typedef struct
 {
-    Vec2f p0;     // top left on screen
-    Vec2f p1;     // bottom right on screen
-    Vec2f tex_p0; // top left on texture
-    Vec2f tex_p1; // bottom right on texture
-    Vec4f colors[4];
-    float corner_radius;
-    float edge_softness;
-    float border_thickness;
+    I16 p0[2];     // top left on screen (DRAW_POS_SCALE fixed point)
+    I16 p1[2];     // bottom right on screen
+    U16 tex_p0[2]; // top left on texture (normalized)
+    U16 tex_p1[2]; // bottom right on texture
+    Color color1;
+    Color color2;
+    U8 corner_radius;    // px, the high byte of border_thickness for shapes
+    U8 edge_softness;    // DRAW_SOFTNESS_SCALE steps
+    U8 border_thickness; // DRAW_BORDER_SCALE steps
+    U8 flags;            // DrawRectFlag
+    I16 clip_p0[2];      // top left of the clip rect (DRAW_POS_SCALE fixed point)
+    I16 clip_p1[2];      // bottom right of the clip rect
+    U8 layer;            // atlas page sampled by textured instances
+    U8 pipeline;         // ShaderBasicVariant, picked when queued
+    U16 depth;           // draw order, only set in the uploaded copy
 } DrawRect;
 
 typedef struct
 {
-    int w,h,n;
-    unsigned char* data;
-    int texture;
-} Image;
+    I16 p0[2];
+    I16 p1[2];
+} DrawClip;
+
+#define FONT_KERN_TTF 0x80000000u
+
+// kerning pairs in an open addressed table, keyed by the kern_id of the
+// left char in the high and of the right one in the low 32 bits. Only
+// read while laying out, the result is kept with the cached glyph runs.
+// Most chars start no pair, the left bits skip the lookup for them
+typedef struct
+{
+    U64* keys;     // 0 if the slot is empty
+    float* values; // em
+    U32 mask;
+    int count;
+
+    bool has_baked; // pairs only join baked or runtime chars, without baked ones ascii never kerns
+    U8  left_baked[FONT_PACK_CHARS]; // 1 if the baked char starts a pair
+    U64 left_ttf[65536/64];          // bit per runtime glyph that starts a pair
+} FontKerning;
+
+// queued rects are written into fixed size chunks that are chained together.
+// chunks are carved out of an arena and kept around between frames, so
+// once the queue has grown to its working size no more allocations happen.
+typedef struct DrawChunk DrawChunk;
+typedef struct DrawList DrawList;
+struct DrawChunk
+{
+    DrawChunk* next;
+    int count;
+    DrawRect rects[DRAW_CHUNK_RECTS];
+    U32 sort[DRAW_CHUNK_RECTS]; // layer, z and regroup bit of each rect, see DrawList.sort_bits
+};
+
+static FontChar font_chars[FONT_PACK_CHARS];
+
+// advances of font_chars as a flat table, for gathering during measurement
+static float font_advances[FONT_PACK_CHARS];
+
+static FontKerning font_kerning = {0};
+
+// unscaled text sizes, direct mapped by string hash. entries match on
+// the 64 bit hash and length only, the string itself isn't kept
+typedef struct
+{
+    U64 hash;
+    int len;
+    float width; // in font units, multiply by the font size
+    int lines;
+} MeasureEntry;
+
+static THREAD_LOCAL MeasureEntry measure_cache[MEASURE_CACHE_SIZE];
+static AtlasRegion font_region = {0};
+
+// tried in order for the runtime glyphs
+static const char* font_ttf_paths[] = {
+    "src/fonts/fallback.ttf",
+    "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf",
+    "C:/Windows/Fonts/arial.ttf",
+    "/Library/Fonts/Arial Unicode.ttf",
+};
+
+// Glyphs outside the baked ascii atlas are rasterized from a ttf on first
+// use (see ttf.c) into fixed size cells of an atlas region. Metrics of every
+// requested code point are kept, the cells are reused least recently used
+// first once all are taken. A cell used in the current frame is never
+// reused, so glyphs that are already queued stay valid until the commit.
+// Lookups can come from any recording thread, draw_commit() uploads the
+// cells that changed.
+typedef struct
+{
+    U32 codepoint;
+    bool empty; // nothing to draw, e.g. spaces
+    int glyph;  // in the ttf
+    int cell;   // -1 if not rasterized
+    FontChar fc;
+} FontGlyph;
+
+typedef struct
+{
+    int glyph;  // FontGlyph index, -1 if free
+    U32 serial; // changes whenever the cell gets a new glyph
+    U32 last_frame;
+    int lru_prev;
+    int lru_next;
+    bool pending; // waiting for upload
+} FontCell;
+
+// a cell as it was when a glyph run was laid out
+typedef struct
+{
+    int cell;
+    U32 serial;
+} FontCellRef;
+
+static struct
+{
+    bool loaded;
+    TtfFont ttf;
+
+    AtlasRegion region;
+    U8* pixels; // cpu copy of the region, rgba
+
+    // code point -> glyphs[] index+1, in pages of 256 code points that are
+    // only allocated once a code point in them is used
+    U16* glyph_pages[FONT_GLYPH_PAGE_COUNT];
+    FontGlyph glyphs[FONT_GLYPH_MAX];
+    int glyph_count;
+
+    FontCell cells[FONT_CELL_COUNT];
+    int lru_first; // most recently used
+    int lru_last;
+
+    int pending[FONT_CELL_COUNT];
+    int pending_count;
+
+    U32 serial;
+    U32 frame;
+    bool warned_full;
+} glyph_atlas = {0};
+
+static pthread_mutex_t glyph_atlas_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// font work that needs no GL, done by jobs from draw_start_loading() on
+static struct
+{
+    bool started;
+    Job source_job;
+    Job ttf_job;
+
+    FontSource source;
+
+    TtfFont ttf;
+    const char* ttf_path; // NULL if none was found
+    TtfKernPair* ttf_pairs;
+    int ttf_pair_count;
+} font_loading = {0};
+
+static int vbo_capacity = 0; // in rects, per ring segment
+
+// The vbo is split into DRAW_RING_SEGMENTS segments that are cycled through
+// each commit. Each segment gets a fence so we only ever write into a
+// segment once the gpu is done drawing from it.
+static struct
+{
+    bool persistent; // mapped once for its lifetime (ARB_buffer_storage)
+    U8* mapped;
+    size_t segment_size; // bytes
+    int segment;
+    GLsync fences[DRAW_RING_SEGMENTS];
+} ring = {0};
+
+int  rect_count = 0; // over all draw lists, counted at commit
 
 typedef struct
 {
-    float l,b,r,t;
-} CharBox;
+    U64 frames_drawn;
+    U64 frames_skipped; // draw list was identical to the last drawn frame
+    int gl_calls;       // GL_CALL()s between the last two commits, uploads included
+
+    // last drawn frame
+    int instances_queued;
+    int instances_culled; // off screen or hidden under opaque rects
+    int instances_opaque; // drawn front to back in the depth pass
+    U64 bytes_uploaded;
+    int draw_calls;
+    int generic_runs; // short runs merged into one generic draw, counted in draw_calls
+} DrawStats;
+
+static DrawStats draw_stats = {0};
+
+// GL_TIMESTAMP query pairs around the gpu work of each drawn commit. They're
+// read back in order once available, a few commits later, so the cpu never
+// waits on the gpu for them. If all are still pending a commit goes untimed.
+static struct
+{
+    GLuint queries[DRAW_GPU_QUERIES][2]; // start, end
+    int head;    // next query to issue
+    int pending; // issued but not read back, the oldest is head-pending
+    double ms;   // latest result
+    bool has_result;
+} gpu_timer = {0};
+
+// queued rects in draw order, built at commit time. culled entries are set to NULL
+static DrawRect** draw_order = NULL;
+static int draw_order_capacity = 0;
+
+// sort key of each draw_order entry, plus scratch space for the radix sort
+static U64* draw_keys = NULL;
+static U64* draw_keys_tmp = NULL;
+static DrawRect** draw_order_tmp = NULL;
+
+// coarse occlusion grid used by the cull pass, one byte per tile
+static U8* cull_tiles = NULL;
+static int cull_tiles_capacity = 0;
+
+// default clip rect, covers the whole representable range
+static const DrawClip clip_none = {{INT16_MIN, INT16_MIN}, {INT16_MAX, INT16_MAX}};
+
+// Laid out strings, keyed by string content, scale and font. Each run holds
+// one template instance per visible glyph, positioned relative to the string
+// origin, so drawing a cached string is a translated copy into the queue.
+// Runs are evicted least recently used first once over GLYPH_CACHE_MAX_BYTES.
+typedef struct GlyphRun GlyphRun;
+struct GlyphRun
+{
+    GlyphRun* hash_next;
+    GlyphRun* lru_prev;
+    GlyphRun* lru_next;
+
+    U64 hash;
+    float scale;
+    U32 font_generation;
+    int len;
+    char* str;
+
+    int glyph_count;
+    DrawRect* glyphs;
+
+    // runtime glyph cells the run draws from, checked on every hit
+    int ref_count;
+    FontCellRef* refs;
+
+    size_t bytes;
+};
 
 typedef struct
 {
-    float advance;
-    CharBox plane_box;
-    CharBox pixel_box;
-    CharBox tex_coords;
-    float w,h;
-} FontChar;
+    GlyphRun* buckets[GLYPH_CACHE_BUCKETS];
+    GlyphRun* lru_first; // most recently used
+    GlyphRun* lru_last;
+    size_t bytes;
+} GlyphCache;
+
+// bumped when the font is (re)loaded, invalidates cached runs and sizes
+static U32 font_generation = 0;
+
+// Everything the draw functions write to. Each thread records into its own
+// list (see draw_set_list()), so independent panels can be built in parallel.
+// draw_commit() concatenates the lists in creation order, the main list first.
+struct DrawList
+{
+    Arena* arena;       // chunks, kept between frames
+    Arena* frame_arena; // formatted strings, reset every commit
+
+    DrawChunk* chunk_first;
+    DrawChunk* chunk_current;
+    int rect_count;
+
+    // rolling hash of the instances written so far. The last rect is still
+    // being filled in by its caller, so it's mixed in by the next push
+    U64 hash;
+    DrawRect* hash_pending;
+
+    // style applied by the rect functions
+    int corner_radius;
+    int edge_softness;
+    DrawLineCap line_cap;
+
+    // written next to every instance, turned into its sort key at commit:
+    // layer << 24 | z << 8 | regroup
+    U32 sort_bits;
+
+    // clip rect written into every instance, the top of the clip stack
+    DrawClip clip_stack[DRAW_CLIP_STACK_MAX];
+    int clip_count;
+    DrawClip clip_current;
+
+    GlyphCache glyph_cache;
+};
 
-static FontChar font_chars[255];
-Image font_image = {0};
+static DrawList* draw_lists[DRAW_MAX_LISTS];
+static int draw_list_count = 0;
+static pthread_mutex_t draw_lists_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-DrawRect queued_rects[MAX_RECTS] = {0};
-int  rect_count = 0;
+static DrawList* draw_list_main = NULL;
+static THREAD_LOCAL DrawList* draw_list_current = NULL; // NULL means the main list
+
+static Vec4f clear_color = {0};
+static U64  last_frame_hash = 0;
+static bool frame_dirty = true;
+static bool split_rects = true;
 
 bool scale_view = true;
-int default_corner_radius = 2.0;
-int default_edge_softness = 1.0;
 
-GLuint loc_res;
-GLuint loc_font_image;
-GLuint loc_verts[4];
+typedef struct
+{
+    GLuint program;
+    GLint loc_res;
+    GLint loc_atlas;
+    GLint loc_verts[4];
+} DrawPipeline;
+
+static DrawPipeline draw_pipelines[SHADER_BASIC_VARIANT_COUNT];
+
+// consecutive instances that share a pipeline, drawn with one call
+typedef struct
+{
+    int pipeline;
+    bool opaque; // drawn without blending
+    int first;
+    int count;
+} DrawRun;
+
+static DrawRun* draw_runs = NULL;
+static int draw_runs_capacity = 0;
 
 Vec4f color(float r, float g, float b)
 {
@@ -100,389 +471,2255 @@ Vec4f colora(float r, float g, float b, float a)
     return c;
 }
 
-bool load_image(const char* image_path, Image* image, bool flip)
+static inline I16 draw_quantize_pos(float v)
 {
-    stbi_set_flip_vertically_on_load(flip);
-    image->data = stbi_load(image_path, &image->w, &image->h, &image->n, 4);
+    v = floorf(v*DRAW_POS_SCALE + 0.5f);
+    return (I16)CLAMP(v, -32768.0f, 32767.0f);
+}
 
-    if(!image->data)
-    {
-        loge("Failed to load image: %s", image_path);
-        return false;
-    }
+static inline U16 draw_quantize_uv(float v)
+{
+    v = floorf(v*65535.0f + 0.5f);
+    return (U16)CLAMP(v, 0.0f, 65535.0f);
+}
+
+static inline U8 draw_quantize_style(float v, float scale)
+{
+    v = floorf(v*scale + 0.5f);
+    return (U8)CLAMP(v, 0.0f, 255.0f);
+}
+
+// shapes have no corners, their thickness takes corner_radius as well
+static inline U16 draw_quantize_thickness(float v)
+{
+    v = floorf(v*DRAW_BORDER_SCALE + 0.5f);
+    return (U16)CLAMP(v, 0.0f, 65535.0f);
+}
+
+// true if the rect is entirely outside the current clip rect
+static inline DrawList* draw_get_list()
+{
+    DrawList* list = draw_list_current;
+    return list ? list : draw_list_main;
+}
+
+static inline bool draw_clip_rejects(DrawList* list, I16 x0, I16 y0, I16 x1, I16 y1)
+{
+    DrawClip* clip = &list->clip_current;
+    return (x1 <= clip->p0[0] || y1 <= clip->p0[1] ||
+            x0 >= clip->p1[0] || y0 >= clip->p1[1]);
+}
 
-    logi("Loaded image: %s (w: %d, h: %d, n: %d)", image_path, image->w, image->h, image->n);
+static inline Color draw_pack_color(Vec4f c)
+{
+    Color p;
+    p.r = (U8)(CLAMP(c.x, 0.0f, 1.0f)*255.0f + 0.5f);
+    p.g = (U8)(CLAMP(c.y, 0.0f, 1.0f)*255.0f + 0.5f);
+    p.b = (U8)(CLAMP(c.z, 0.0f, 1.0f)*255.0f + 0.5f);
+    p.a = (U8)(CLAMP(c.w, 0.0f, 1.0f)*255.0f + 0.5f);
+    return p;
+}
 
-    glGenTextures(1, &image->texture);
+static void glyph_atlas_lru_unlink(int c)
+{
+    FontCell* cell = &glyph_atlas.cells[c];
 
-	glBindTexture(GL_TEXTURE_2D, image->texture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image->w, image->h, 0, GL_RGBA, GL_UNSIGNED_BYTE, image->data);
+    if(cell->lru_prev >= 0) glyph_atlas.cells[cell->lru_prev].lru_next = cell->lru_next;
+    else glyph_atlas.lru_first = cell->lru_next;
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    if(cell->lru_next >= 0) glyph_atlas.cells[cell->lru_next].lru_prev = cell->lru_prev;
+    else glyph_atlas.lru_last = cell->lru_prev;
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    cell->lru_prev = -1;
+    cell->lru_next = -1;
+}
 
-    glBindTexture(GL_TEXTURE_2D, 0);
+static void glyph_atlas_lru_push_front(int c)
+{
+    FontCell* cell = &glyph_atlas.cells[c];
 
-    return true;
+    cell->lru_prev = -1;
+    cell->lru_next = glyph_atlas.lru_first;
+
+    if(glyph_atlas.lru_first >= 0) glyph_atlas.cells[glyph_atlas.lru_first].lru_prev = c;
+    glyph_atlas.lru_first = c;
+
+    if(glyph_atlas.lru_last < 0) glyph_atlas.lru_last = c;
 }
 
-void load_font()
+static void glyph_atlas_touch(int c)
 {
-    bool loaded = load_image(FONT_PATH_IMAGE, &font_image, false);
-    if(!loaded) return;
+    glyph_atlas.cells[c].last_frame = glyph_atlas.frame;
+    glyph_atlas_lru_unlink(c);
+    glyph_atlas_lru_push_front(c);
+}
 
-    logi("Font loaded at index: %d", font_image.texture);
+// takes over the ttf the loading job found
+static void glyph_atlas_init()
+{
+    const char* path = font_loading.ttf_path;
 
-    FILE* fp = fopen(FONT_PATH_LAYOUT,"r");
+    if(!path)
+    {
+        logw("No ttf font found, only the baked ascii glyphs are available");
+        return;
+    }
 
-    if(!fp)
+    if(!atlas_alloc(FONT_CACHE_W, FONT_CACHE_H, &glyph_atlas.region))
     {
-        logw("Failed to load font layout file");
+        ttf_free(&font_loading.ttf);
         return;
     }
 
-    char line[256] = {0};
+    glyph_atlas.ttf = font_loading.ttf;
 
-    while(fgets(line,255,fp) != NULL)
+    glyph_atlas.pixels = (U8*)calloc(FONT_CACHE_W*FONT_CACHE_H, 4);
+
+    glyph_atlas.lru_first = -1;
+    glyph_atlas.lru_last = -1;
+
+    for(int c = 0; c < FONT_CELL_COUNT; ++c)
     {
-        int char_index = 0;
-        float advance, pl_l, pl_b, pl_r, pl_t,  px_l, px_b, px_r, px_t;
+        glyph_atlas.cells[c].glyph = -1;
+        glyph_atlas.cells[c].lru_prev = -1;
+        glyph_atlas.cells[c].lru_next = -1;
+        glyph_atlas_lru_push_front(c);
+    }
 
-        int n = sscanf(line,"%d,%f,%f,%f,%f,%f,%f,%f,%f,%f ",&char_index,&advance,&pl_l, &pl_b, &pl_r, &pl_t, &px_l, &px_b, &px_r, &px_t);
+    glyph_atlas.loaded = true;
 
-        if(n != 10)
-            continue;
+    logi("Runtime glyphs from %s (%d cells in atlas layer %d)", path, FONT_CELL_COUNT, glyph_atlas.region.layer);
+}
+
+// metrics of cp, added on first use. NULL if the table is full.
+// Needs glyph_atlas_mutex
+static FontGlyph* glyph_atlas_find(U32 cp)
+{
+    if(cp > 0x10FFFF)
+        return NULL;
 
-        font_chars[char_index].advance = advance;
+    U16** page = &glyph_atlas.glyph_pages[cp >> FONT_GLYPH_PAGE_BITS];
+    U32 slot = cp & (FONT_GLYPH_PAGE_SIZE-1);
 
-        font_chars[char_index].plane_box.l = pl_l;
-        font_chars[char_index].plane_box.b = pl_b;
-        font_chars[char_index].plane_box.r = pl_r;
-        font_chars[char_index].plane_box.t = pl_t;
+    if(*page && (*page)[slot])
+        return &glyph_atlas.glyphs[(*page)[slot]-1];
 
-        font_chars[char_index].pixel_box.l = px_l;
-        font_chars[char_index].pixel_box.b = px_b;
-        font_chars[char_index].pixel_box.r = px_r;
-        font_chars[char_index].pixel_box.t = px_t;
+    if(glyph_atlas.glyph_count >= FONT_GLYPH_MAX)
+        return NULL;
 
-        font_chars[char_index].tex_coords.l = px_l/404.0;
-        font_chars[char_index].tex_coords.b = 1.0 - (px_b/404.0);
-        font_chars[char_index].tex_coords.r = px_r/404.0;
-        font_chars[char_index].tex_coords.t = 1.0 - (px_t/404.0);
+    if(!*page)
+        *page = (U16*)calloc(FONT_GLYPH_PAGE_SIZE, sizeof(U16));
 
-        font_chars[char_index].w = px_r - px_l;
-        font_chars[char_index].h = px_b - px_t;
+    FontGlyph* g = &glyph_atlas.glyphs[glyph_atlas.glyph_count];
+    TtfFont* ttf = &glyph_atlas.ttf;
 
-        // printf("font_char %d: %f [%f %f %f %f], [%f %f %f %f], [%f %f %f %f]\n",char_index,advance,pl_l,pl_b,pl_r,pl_t,px_l,px_b,px_r,px_t,px_l/512.0,px_b/512.0,px_r/512.0,px_t/512.0);
-    }
+    memset(g, 0, sizeof(FontGlyph));
+    g->codepoint = cp;
+    g->cell = -1;
+    g->glyph = ttf_find_glyph(ttf, cp);
+    g->fc.kern_id = FONT_KERN_TTF | (U32)g->glyph;
 
-    fclose(fp);
+    int advance, lsb;
+    ttf_get_hmetrics(ttf, g->glyph, &advance, &lsb);
+    g->fc.advance = advance / (float)ttf->units_per_em;
+
+    int x0, y0, x1, y1;
+    g->empty = !ttf_get_glyph_box(ttf, g->glyph, &x0, &y0, &x1, &y1);
+
+    (*page)[slot] = (U16)++glyph_atlas.glyph_count;
+    return g;
 }
 
-void draw_init()
+// renders g into the least recently used cell. false if every cell is in
+// use this frame. Needs glyph_atlas_mutex
+static bool glyph_atlas_rasterize(FontGlyph* g)
 {
-    logi("GL version: %s",glGetString(GL_VERSION));
+    int c = glyph_atlas.lru_last;
+    FontCell* cell = &glyph_atlas.cells[c];
 
-    memset(queued_rects, 0, MAX_RECTS*sizeof(DrawRect));
-    rect_count = 0;
+    if(cell->glyph >= 0 && cell->last_frame == glyph_atlas.frame)
+    {
+        if(!glyph_atlas.warned_full)
+            logw("Runtime glyph atlas is full this frame, %d cells", FONT_CELL_COUNT);
+        glyph_atlas.warned_full = true;
+        return false;
+    }
 
-    glGenVertexArrays(1, &vao);
-    glBindVertexArray(vao);
+    if(cell->glyph >= 0)
+        glyph_atlas.glyphs[cell->glyph].cell = -1;
 
-    glGenBuffers(1, &vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, MAX_RECTS*sizeof(DrawRect), NULL, GL_STREAM_DRAW);
-
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(DrawRect),(const GLvoid*)(0)); // p0
-    glVertexAttribDivisor(0, 1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(DrawRect),(const GLvoid*)(8)); // p1
-    glVertexAttribDivisor(1, 1);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(DrawRect),(const GLvoid*)(16)); // tex_p0
-    glVertexAttribDivisor(2, 1);
-    glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(DrawRect),(const GLvoid*)(24)); // tex_p1
-    glVertexAttribDivisor(3, 1);
-    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(DrawRect),(const GLvoid*)(32)); // colors[0]
-    glVertexAttribDivisor(4, 1);
-    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(DrawRect),(const GLvoid*)(48)); // colors[1]
-    glVertexAttribDivisor(5, 1);
-    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(DrawRect),(const GLvoid*)(64)); // colors[2]
-    glVertexAttribDivisor(6, 1);
-    glVertexAttribPointer(7, 4, GL_FLOAT, GL_FALSE, sizeof(DrawRect),(const GLvoid*)(80)); // colors[3]
-    glVertexAttribDivisor(7, 1);
-    glVertexAttribPointer(8, 1, GL_FLOAT, GL_FALSE, sizeof(DrawRect),(const GLvoid*)(96)); // corner_radius
-    glVertexAttribDivisor(8, 1);
-    glVertexAttribPointer(9, 1, GL_FLOAT, GL_FALSE, sizeof(DrawRect),(const GLvoid*)(100)); // edge_softness
-    glVertexAttribDivisor(9, 1);
-    glVertexAttribPointer(10, 1, GL_FLOAT, GL_FALSE, sizeof(DrawRect),(const GLvoid*)(104)); // border_radius
-    glVertexAttribDivisor(10, 1);
+    TtfFont* ttf = &glyph_atlas.ttf;
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    int x0, y0, x1, y1;
+    ttf_get_glyph_box(ttf, g->glyph, &x0, &y0, &x1, &y1);
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    // padded for the distance range, scaled down if it wouldn't fit the cell
+    // with a px to spare, which keeps filtering from reaching the next cell
+    const int pad = (int)ceilf(FONT_SDF_RANGE/2.0f) + 1;
+    int extent = MAX(x1-x0, y1-y0);
 
-    loc_res = glGetUniformLocation(program, "res");
-    loc_font_image = glGetUniformLocation(program, "font_image");
+    float scale = FONT_PX_PER_EM / (float)ttf->units_per_em;
+    scale = MIN(scale, (FONT_CELL_SIZE - 1 - 2*pad - 2) / (float)extent);
 
-    loc_verts[0] = glGetUniformLocation(program, "verts[0]");
-    loc_verts[1] = glGetUniformLocation(program, "verts[1]");
-    loc_verts[2] = glGetUniformLocation(program, "verts[2]");
-    loc_verts[3] = glGetUniformLocation(program, "verts[3]");
+    int bx0 = (int)floorf(x0*scale) - pad;
+    int by0 = (int)floorf(y0*scale) - pad;
+    int bx1 = (int)ceilf(x1*scale) + pad;
+    int by1 = (int)ceilf(y1*scale) + pad;
+    int w = bx1 - bx0;
+    int h = by1 - by0;
 
-    load_font();
+    int cx = (c % (FONT_CACHE_W/FONT_CELL_SIZE))*FONT_CELL_SIZE;
+    int cy = (c / (FONT_CACHE_W/FONT_CELL_SIZE))*FONT_CELL_SIZE;
+    int stride = FONT_CACHE_W*4;
 
-}
+    U8* dst = glyph_atlas.pixels + cy*stride + cx*4;
+    for(int y = 0; y < FONT_CELL_SIZE; ++y)
+        memset(dst + y*stride, 0, FONT_CELL_SIZE*4);
 
-void draw_clear_screen(float r, float g, float b)
-{
-    glClearColor(r, g, b, 0.0);
-    glClear(GL_COLOR_BUFFER_BIT);
-}
+    ttf_render_sdf(ttf, g->glyph, scale, bx0, by1, FONT_SDF_RANGE, dst, w, h, stride);
 
-void draw_rect_full(float x, float y, float w, float h, Vec4f color1, Vec4f color2, bool gradient_horizontal, float border_thickness, float corner_radius, float edge_softness)
-{
-    if(rect_count >= MAX_RECTS)
+    // plane box in em (y up), like the baked glyphs
+    float em = scale*ttf->units_per_em;
+
+    g->fc.plane_box.l = bx0 / em;
+    g->fc.plane_box.b = by0 / em;
+    g->fc.plane_box.r = bx1 / em;
+    g->fc.plane_box.t = by1 / em;
+
+    g->fc.tex_coords.l = (glyph_atlas.region.x + cx) / (float)ATLAS_PAGE_SIZE;
+    g->fc.tex_coords.t = (glyph_atlas.region.y + cy) / (float)ATLAS_PAGE_SIZE;
+    g->fc.tex_coords.r = (glyph_atlas.region.x + cx + w) / (float)ATLAS_PAGE_SIZE;
+    g->fc.tex_coords.b = (glyph_atlas.region.y + cy + h) / (float)ATLAS_PAGE_SIZE;
+
+    g->fc.w = w;
+    g->fc.h = h;
+
+    g->cell = c;
+    cell->glyph = g - glyph_atlas.glyphs;
+    cell->serial = ++glyph_atlas.serial;
+
+    if(!cell->pending)
     {
-        logw("Hit rect count max, failed to queue drawing routine");
-        return;
+        cell->pending = true;
+        glyph_atlas.pending[glyph_atlas.pending_count++] = c;
     }
 
-    DrawRect* rect = &queued_rects[rect_count++];
+    return true;
+}
+
+// runtime glyph of cp, rasterized if it isn't yet. ref->cell is the cell it
+// was drawn from, -1 if there's nothing to draw. false if cp isn't available
+static bool glyph_atlas_get(U32 cp, FontChar* fc, FontCellRef* ref)
+{
+    ref->cell = -1;
 
-    rect->p0.x = x;
-    rect->p0.y = y;
-    rect->p1.x = x+w;
-    rect->p1.y = y+h;
+    if(!glyph_atlas.loaded)
+        return false;
 
-    rect->tex_p0.x = 0.0;
-    rect->tex_p0.y = 0.0;
-    rect->tex_p1.x = 0.0;
-    rect->tex_p1.y = 0.0;
+    pthread_mutex_lock(&glyph_atlas_mutex);
 
-    for(int i = 0; i < 4; ++i)
+    FontGlyph* g = glyph_atlas_find(cp);
+    if(g)
     {
-        if(gradient_horizontal)
-        {
-            rect->colors[i].x = i < 2 ? color1.x : color2.x;
-            rect->colors[i].y = i < 2 ? color1.y : color2.y;
-            rect->colors[i].z = i < 2 ? color1.z : color2.z;
-            rect->colors[i].w = i < 2 ? color1.w : color2.w;
-        }
-        else
+        if(!g->empty && (g->cell >= 0 || glyph_atlas_rasterize(g)))
         {
-            rect->colors[i].x = (i == 0 || i == 2) ? color1.x : color2.x;
-            rect->colors[i].y = (i == 0 || i == 2) ? color1.y : color2.y;
-            rect->colors[i].z = (i == 0 || i == 2) ? color1.z : color2.z;
-            rect->colors[i].w = (i == 0 || i == 2) ? color1.w : color2.w;
+            glyph_atlas_touch(g->cell);
+            ref->cell = g->cell;
+            ref->serial = glyph_atlas.cells[g->cell].serial;
         }
+
+        *fc = g->fc;
+
+        // advance only
+        if(ref->cell < 0)
+            memset(&fc->plane_box, 0, sizeof(CharBox));
     }
 
-    rect->corner_radius = corner_radius;
-    rect->edge_softness = edge_softness;
-    rect->border_thickness = border_thickness;
-}
+    pthread_mutex_unlock(&glyph_atlas_mutex);
 
-void draw_rect(float x, float y, float w, float h, Vec4f color)
-{
-    draw_rect_full(x, y, w, h, color, color, true, 0.0, default_corner_radius, default_edge_softness);
+    return g != NULL;
 }
 
-void draw_rect_frame(float x, float y, float w, float h, Vec4f color, float border_thickness)
+static float glyph_atlas_get_advance(U32 cp, U32* kern_id)
 {
-    draw_rect_full(x, y, w, h, color, color, true, border_thickness, default_corner_radius, default_edge_softness);
-}
+    float advance = font_chars['?'].advance;
+    *kern_id = font_chars['?'].kern_id;
 
-void draw_rect_hgrad(float x, float y, float w, float h, Vec4f color1, Vec4f color2)
-{
-    draw_rect_full(x, y, w, h, color1, color2, true, 0.0, default_corner_radius, default_edge_softness);
+    if(!glyph_atlas.loaded)
+        return advance;
+
+    pthread_mutex_lock(&glyph_atlas_mutex);
+
+    FontGlyph* g = glyph_atlas_find(cp);
+    if(g)
+    {
+        advance = g->fc.advance;
+        *kern_id = g->fc.kern_id;
+    }
+
+    pthread_mutex_unlock(&glyph_atlas_mutex);
+
+    return advance;
 }
 
-void draw_rect_vgrad(float x, float y, float w, float h, Vec4f color1, Vec4f color2)
+// marks the cells of a cached run as used this frame. false if any of them
+// was given to another glyph since, the run has to be laid out again
+static bool glyph_atlas_touch_refs(FontCellRef* refs, int count)
 {
-    draw_rect_full(x, y, w, h, color1, color2, false, 0.0, default_corner_radius, default_edge_softness);
+    bool valid = true;
+
+    pthread_mutex_lock(&glyph_atlas_mutex);
+
+    for(int i = 0; i < count && valid; ++i)
+    {
+        valid = (glyph_atlas.cells[refs[i].cell].serial == refs[i].serial);
+        if(valid)
+            glyph_atlas_touch(refs[i].cell);
+    }
+
+    pthread_mutex_unlock(&glyph_atlas_mutex);
+
+    return valid;
 }
 
-void draw_set_rect_corner_radius(float r)
+// uploads the cells rasterized since the last commit
+static void glyph_atlas_flush()
 {
-    default_corner_radius = r;
+    pthread_mutex_lock(&glyph_atlas_mutex);
+
+    for(int i = 0; i < glyph_atlas.pending_count; ++i)
+    {
+        int c = glyph_atlas.pending[i];
+        int cx = (c % (FONT_CACHE_W/FONT_CELL_SIZE))*FONT_CELL_SIZE;
+        int cy = (c / (FONT_CACHE_W/FONT_CELL_SIZE))*FONT_CELL_SIZE;
+
+        U8* src = glyph_atlas.pixels + (cy*FONT_CACHE_W + cx)*4;
+        atlas_upload_rect(&glyph_atlas.region, cx, cy, FONT_CELL_SIZE, FONT_CELL_SIZE, src, FONT_CACHE_W);
+
+        glyph_atlas.cells[c].pending = false;
+    }
+
+    glyph_atlas.pending_count = 0;
+
+    pthread_mutex_unlock(&glyph_atlas_mutex);
 }
-void draw_set_rect_edge_softness(float v)
+
+static void glyph_atlas_end_frame()
 {
-    default_edge_softness = v;
+    pthread_mutex_lock(&glyph_atlas_mutex);
+    glyph_atlas.frame++;
+    glyph_atlas.warned_full = false;
+    pthread_mutex_unlock(&glyph_atlas_mutex);
 }
 
-// w,h
-Vec2f string_get_size(float scale, char* fmt, ...)
+// glyph of the char at str[*i], moving *i past it. ascii comes from the
+// baked atlas, everything else from the runtime glyphs with '?' as the
+// fallback. ref->cell is set if the glyph is drawn from a runtime cell
+static FontChar* font_next_char(char* str, int len, int* i, FontChar* tmp, U8* layer, FontCellRef* ref)
 {
-    va_list args;
-    va_start(args, fmt);
-    char str[256] = {0};
-    vsprintf(str,fmt, args);
-    va_end(args);
+    U8 c = (U8)str[*i];
 
-    float x_pos = 0.0;
-    float fontsize = 64.0 * scale;
-    int num_lines = 1;
-    float longest_width = 0.0;
+    ref->cell = -1;
+    *layer = font_region.layer;
+
+    if(c < 0x80)
+    {
+        (*i)++;
+        return &font_chars[c];
+    }
 
-    char* c = str;
+    U32 cp = utf8_decode(str, len, i);
+    if(!glyph_atlas_get(cp, tmp, ref))
+        return &font_chars['?'];
 
-    for(;;)
+    *layer = glyph_atlas.region.layer;
+    return tmp;
+}
+
+static void font_kerning_add(U32 left, U32 right, float value)
+{
+    // at most half full
+    if(2*(font_kerning.count+1) > (int)(font_kerning.mask+1))
     {
-        if(*c == '\0')
-            break;
+        U64* keys = font_kerning.keys;
+        float* values = font_kerning.values;
+        U32 capacity = font_kerning.keys ? font_kerning.mask+1 : 0;
 
-        if(*c == '\n')
+        U32 grown = MAX(256, 2*capacity);
+        font_kerning.keys = (U64*)calloc(grown, sizeof(U64));
+        font_kerning.values = (float*)calloc(grown, sizeof(float));
+        font_kerning.mask = grown-1;
+        font_kerning.count = 0;
+
+        for(U32 i = 0; i < capacity; ++i)
         {
-            num_lines++;
-            if(x_pos > longest_width)
-                longest_width = x_pos;
-            x_pos = 0.0;
-            c++;
-            continue;
+            if(keys[i])
+                font_kerning_add((U32)(keys[i] >> 32), (U32)keys[i], values[i]);
         }
 
-        FontChar* fc = &font_chars[*c];
-
-        x_pos += (fontsize*fc->advance);
-        c++;
+        free(keys);
+        free(values);
     }
 
-    if(x_pos > longest_width)
-        longest_width = x_pos;
+    if(left & FONT_KERN_TTF)
+        font_kerning.left_ttf[(left & 0xFFFF) >> 6] |= 1ull << (left & 63);
+    else if(left < FONT_PACK_CHARS)
+        font_kerning.left_baked[left] = font_kerning.has_baked = true;
 
-    Vec2f ret = {longest_width, fontsize*num_lines};
-    return ret;
+    U64 key = ((U64)left << 32) | right;
+    U32 index = (U32)hash_mix64(key) & font_kerning.mask;
+
+    while(font_kerning.keys[index] && font_kerning.keys[index] != key)
+        index = (index+1) & font_kerning.mask;
+
+    if(!font_kerning.keys[index])
+        font_kerning.count++;
+
+    font_kerning.keys[index] = key;
+    font_kerning.values[index] = value;
 }
 
-void draw_string(float x, float y, float scale, Vec4f color, char* format, ...)
+static inline bool font_kerning_has_left(U32 left)
 {
-    va_list args;
-    va_start(args, format);
-    char str[256] = {0};
-    vsprintf(str, format, args);
-    va_end(args);
-
-    float fontsize = 64.0 * scale;
+    if(left & FONT_KERN_TTF)
+        return (font_kerning.left_ttf[(left & 0xFFFF) >> 6] >> (left & 63)) & 1;
 
-    float x_pos = x;
-    float y_pos = y+fontsize;
+    return left < FONT_PACK_CHARS && font_kerning.left_baked[left];
+}
 
-    int num_lines = 1;
+// adjustment between two chars in em, 0 if the pair isn't kerned
+static inline float font_kerning_get(U32 left, U32 right)
+{
+    if(!font_kerning_has_left(left))
+        return 0.0;
 
-    char* c = str;
+    U64 key = ((U64)left << 32) | right;
+    U32 index = (U32)hash_mix64(key) & font_kerning.mask;
 
-    for(;;)
+    for(U64 k; (k = font_kerning.keys[index]); index = (index+1) & font_kerning.mask)
     {
-        if(*c == '\0')
-            break;
+        if(k == key)
+            return font_kerning.values[index];
+    }
 
-        if(*c == '\n')
-        {
-            y_pos += fontsize;
-            x_pos = x;
-            num_lines++;
-            c++;
-            continue;
-        }
+    return 0.0;
+}
 
-        if(rect_count >= MAX_RECTS)
-        {
-            logw("Hit rect count max, failed to queue drawing routine");
-            break;
-        }
+// baked pairs come with the font, the ones of the runtime glyphs from
+// the kern table of their ttf (read by the loading job)
+static void font_kerning_load(FontKern* baked, int baked_count)
+{
+    free(font_kerning.keys);
+    free(font_kerning.values);
+    memset(&font_kerning, 0, sizeof(FontKerning));
 
-        FontChar* fc = &font_chars[*c];
+    for(int i = 0; i < baked_count; ++i)
+        font_kerning_add(baked[i].left, baked[i].right, baked[i].value);
 
-        float x0 = x_pos + fontsize*fc->plane_box.l;
-        float y0 = y_pos - fontsize*fc->plane_box.t;
-        float x1 = x_pos + fontsize*fc->plane_box.r;
-        float y1 = y_pos - fontsize*fc->plane_box.b;
+    TtfKernPair* pairs = font_loading.ttf_pairs;
+    int pair_count = glyph_atlas.loaded ? font_loading.ttf_pair_count : 0;
 
-        DrawRect* rect = &queued_rects[rect_count++];
+    float units = (float)glyph_atlas.ttf.units_per_em;
+    for(int i = 0; i < pair_count; ++i)
+        font_kerning_add(FONT_KERN_TTF | pairs[i].left, FONT_KERN_TTF | pairs[i].right, pairs[i].value/units);
 
-        rect->p0.x = x0;
-        rect->p0.y = y0;
-        rect->p1.x = x1;
-        rect->p1.y = y1;
+    free(font_loading.ttf_pairs);
+    font_loading.ttf_pairs = NULL;
+    font_loading.ttf_pair_count = 0;
 
-        rect->tex_p0.x = fc->tex_coords.l;
-        rect->tex_p0.y = fc->tex_coords.t;
-        rect->tex_p1.x = fc->tex_coords.r;
-        rect->tex_p1.y = fc->tex_coords.b;
+    if(font_kerning.count > 0)
+        logi("Kerning pairs: %d baked, %d runtime", baked_count, pair_count);
+}
 
-        for(int i = 0; i < 4; ++i)
-        {
-            rect->colors[i].x = color.x;
-            rect->colors[i].y = color.y;
-            rect->colors[i].z = color.z;
-            rect->colors[i].w = color.w;
-        }
+static void font_source_job(void* arg)
+{
+    (void)arg;
+    font_source_load(&font_loading.source, FONT_PATH_PACK, FONT_PATH_IMAGE, FONT_PATH_LAYOUT, FONT_PATH_KERNING);
+}
 
-        c++;
-        x_pos += (fontsize*fc->advance);
+static void font_ttf_job(void* arg)
+{
+    (void)arg;
+
+    for(size_t i = 0; i < ArrayCount(font_ttf_paths) && !font_loading.ttf_path; ++i)
+    {
+        if(ttf_load(&font_loading.ttf, font_ttf_paths[i]))
+            font_loading.ttf_path = font_ttf_paths[i];
     }
+
+    if(font_loading.ttf_path)
+        font_loading.ttf_pair_count = ttf_get_kerning(&font_loading.ttf, &font_loading.ttf_pairs);
 }
 
-void draw_commit()
+void draw_start_loading()
 {
-    glUseProgram(program);
-    glBindVertexArray(vao);
+    if(font_loading.started)
+        return;
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, font_image.texture);
-    glUniform1i(loc_font_image, 0);
+    font_loading.started = true;
+    font_loading.ttf_path = NULL;
 
-    if(scale_view)
+    job_start(&font_loading.source_job, "font source", font_source_job, NULL);
+    job_start(&font_loading.ttf_job, "font ttf", font_ttf_job, NULL);
+}
+
+// waits for the loading jobs, only the uploads happen here
+void load_font()
+{
+    draw_start_loading();
+
+    job_wait(&font_loading.source_job);
+    job_wait(&font_loading.ttf_job);
+    font_loading.started = false;
+
+    double start = timer_get_time();
+
+    FontSource* source = &font_loading.source;
+
+    if(!source->loaded || !atlas_alloc(source->w, source->h, &font_region))
     {
-        glUniform2f(loc_res,(float)view_width, (float)view_height);
+        if(font_loading.ttf_path)
+            ttf_free(&font_loading.ttf);
+
+        free(font_loading.ttf_pairs);
+        font_loading.ttf_pairs = NULL;
+
+        font_source_free(source);
+        return;
     }
-    else
+
+    atlas_upload(&font_region, source->pixels);
+    memcpy(font_chars, source->chars, sizeof(font_chars));
+
+    // tex coords are px of the font image, place them in its atlas page
+    for(int c = 0; c < FONT_PACK_CHARS; ++c)
     {
-        glUniform2f(loc_res,(float)window_width, (float)window_height);
+        FontChar* fc = &font_chars[c];
+
+        fc->tex_coords.l = (font_region.x + fc->tex_coords.l) / (float)ATLAS_PAGE_SIZE;
+        fc->tex_coords.b = (font_region.y + fc->tex_coords.b) / (float)ATLAS_PAGE_SIZE;
+        fc->tex_coords.r = (font_region.x + fc->tex_coords.r) / (float)ATLAS_PAGE_SIZE;
+        fc->tex_coords.t = (font_region.y + fc->tex_coords.t) / (float)ATLAS_PAGE_SIZE;
+
+        font_advances[c] = fc->advance;
     }
 
-    glUniform2f(loc_verts[0], -1.0, -1.0);
-    glUniform2f(loc_verts[1], -1.0, +1.0);
-    glUniform2f(loc_verts[2], +1.0, -1.0);
-    glUniform2f(loc_verts[3], +1.0, +1.0);
+    logi("Font loaded into atlas layer: %d (%s, upload %.0f us)", font_region.layer, source->packed ? "pack" : "png", 1000000.0*(timer_get_time() - start));
 
-    // buffer new rect data
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, rect_count*sizeof(DrawRect), queued_rects, GL_STREAM_DRAW);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glyph_atlas_init();
+    font_kerning_load(source->kerns, source->kern_count);
+
+    font_source_free(source);
+
+    font_generation++;
+}
+
+static DrawChunk* draw_chunk_alloc(DrawList* list)
+{
+    DrawChunk* chunk = (DrawChunk*)arena_alloc(list->arena, sizeof(DrawChunk));
+    chunk->next = NULL;
+    chunk->count = 0;
+    return chunk;
+}
+
+// slow path of draw_push_rect(), only hit once per DRAW_CHUNK_RECTS rects
+static DrawChunk* draw_chunk_next(DrawList* list)
+{
+    DrawChunk* chunk = list->chunk_current;
+    if(!chunk->next)
+        chunk->next = draw_chunk_alloc(list);
+
+    list->chunk_current = chunk->next;
+    list->chunk_current->count = 0;
+    return list->chunk_current;
+}
+
+// mixes the finished rect of the last push into the list hash
+static inline void draw_hash_pending(DrawList* list)
+{
+    if(list->hash_pending)
+        list->hash = hash_bytes(list->hash, list->hash_pending, sizeof(DrawRect));
+
+    list->hash_pending = NULL;
+}
+
+static inline DrawRect* draw_push_rect(DrawList* list)
+{
+    DrawChunk* chunk = list->chunk_current;
+    if(chunk->count >= DRAW_CHUNK_RECTS)
+        chunk = draw_chunk_next(list);
+
+    draw_hash_pending(list);
+    list->hash = hash_bytes(list->hash, &list->sort_bits, sizeof(list->sort_bits));
+
+    list->rect_count++;
+    chunk->sort[chunk->count] = list->sort_bits;
+    list->hash_pending = &chunk->rects[chunk->count++];
+    return list->hash_pending;
+}
+
+static void draw_list_reset(DrawList* list)
+{
+    list->chunk_current = list->chunk_first;
+    list->chunk_current->count = 0;
+    list->rect_count = 0;
+
+    list->hash = HASH_SEED;
+    list->hash_pending = NULL;
+
+    list->clip_count = 0;
+    list->clip_current = clip_none;
+
+    // layer and z are per frame, regrouping stays on
+    list->sort_bits &= DRAW_SORT_REGROUP;
+
+    arena_reset(list->frame_arena);
+}
+
+static void draw_reset_queue()
+{
+    for(int i = 0; i < draw_list_count; ++i)
+        draw_list_reset(draw_lists[i]);
 
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-    glEnableVertexAttribArray(3);
-    glEnableVertexAttribArray(4);
-    glEnableVertexAttribArray(5);
-    glEnableVertexAttribArray(6);
-    glEnableVertexAttribArray(7);
-    glEnableVertexAttribArray(8);
-    glEnableVertexAttribArray(9);
-    glEnableVertexAttribArray(10);
-
-    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, rect_count); 
     rect_count = 0;
+    glyph_atlas_end_frame();
+}
+
+// creates a list for a thread to record into. lists are drawn in creation
+// order, after the main list. not to be called while draw_commit() runs
+DrawList* draw_list_create()
+{
+    DrawList* list = (DrawList*)calloc(1, sizeof(DrawList));
+
+    list->arena = arena_create(ARENA_SIZE_MEDIUM);
+    list->frame_arena = arena_create(ARENA_SIZE_SMALL);
+    list->chunk_first = draw_chunk_alloc(list);
+    list->corner_radius = 2;
+    list->edge_softness = 1;
+    list->line_cap = DRAW_LINE_CAP_ROUND;
+    draw_list_reset(list);
+
+    pthread_mutex_lock(&draw_lists_mutex);
+
+    if(draw_list_count >= DRAW_MAX_LISTS)
+    {
+        pthread_mutex_unlock(&draw_lists_mutex);
+        logw("Hit draw list max, failed to create draw list");
+        arena_destroy(list->arena);
+        arena_destroy(list->frame_arena);
+        free(list);
+        return NULL;
+    }
+
+    draw_lists[draw_list_count++] = list;
+
+    pthread_mutex_unlock(&draw_lists_mutex);
+
+    return list;
+}
+
+// the attribute offsets below are hardcoded, these keep DrawRect in step
+STATIC_ASSERT(sizeof(DrawRect) == 40, "DrawRect layout changed, update draw_set_attribs()");
+STATIC_ASSERT(offsetof(DrawRect, tex_p0) == 8, "DrawRect layout changed");
+STATIC_ASSERT(offsetof(DrawRect, color1) == 16, "DrawRect layout changed");
+STATIC_ASSERT(offsetof(DrawRect, color2) == 20, "DrawRect layout changed");
+STATIC_ASSERT(offsetof(DrawRect, corner_radius) == 24, "DrawRect layout changed");
+STATIC_ASSERT(offsetof(DrawRect, clip_p0) == 28, "DrawRect layout changed");
+STATIC_ASSERT(offsetof(DrawRect, layer) == 36, "DrawRect layout changed");
+STATIC_ASSERT(offsetof(DrawRect, pipeline) == 37, "DrawRect layout changed");
+STATIC_ASSERT(offsetof(DrawRect, depth) == 38, "DrawRect layout changed");
+
+// points the instance attributes at the rects starting at byte offset 'base'
+// of the bound vbo. Called every commit since the ring segment changes.
+static void draw_set_attribs(size_t base)
+{
+    GL_CALL(glVertexAttribPointer(0, 4, GL_SHORT, GL_FALSE, sizeof(DrawRect),(const GLvoid*)(base+0))); // p0, p1
+    GL_CALL(glVertexAttribDivisor(0, 1));
+    GL_CALL(glVertexAttribPointer(1, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(DrawRect),(const GLvoid*)(base+8))); // tex_p0, tex_p1
+    GL_CALL(glVertexAttribDivisor(1, 1));
+    GL_CALL(glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(DrawRect),(const GLvoid*)(base+16))); // color1
+    GL_CALL(glVertexAttribDivisor(2, 1));
+    GL_CALL(glVertexAttribPointer(3, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(DrawRect),(const GLvoid*)(base+20))); // color2
+    GL_CALL(glVertexAttribDivisor(3, 1));
+    GL_CALL(glVertexAttribIPointer(4, 4, GL_UNSIGNED_BYTE, sizeof(DrawRect),(const GLvoid*)(base+24))); // corner_radius, edge_softness, border_thickness, flags
+    GL_CALL(glVertexAttribDivisor(4, 1));
+    GL_CALL(glVertexAttribPointer(5, 4, GL_SHORT, GL_FALSE, sizeof(DrawRect),(const GLvoid*)(base+28))); // clip_p0, clip_p1
+    GL_CALL(glVertexAttribDivisor(5, 1));
+    GL_CALL(glVertexAttribIPointer(6, 2, GL_UNSIGNED_BYTE, sizeof(DrawRect),(const GLvoid*)(base+36))); // layer, pipeline
+    GL_CALL(glVertexAttribDivisor(6, 1));
+    GL_CALL(glVertexAttribPointer(7, 1, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(DrawRect),(const GLvoid*)(base+38))); // depth
+    GL_CALL(glVertexAttribDivisor(7, 1));
+}
+
+static void draw_ring_destroy()
+{
+    for(int i = 0; i < DRAW_RING_SEGMENTS; ++i)
+    {
+        if(ring.fences[i])
+            GL_CALL(glDeleteSync(ring.fences[i]));
+        ring.fences[i] = 0;
+    }
+
+    if(ring.mapped)
+    {
+        GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+        GL_CALL(glUnmapBuffer(GL_ARRAY_BUFFER));
+        GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        ring.mapped = NULL;
+    }
+}
+
+// (re)creates the ring with room for 'capacity' rects per segment.
+// Storage made with glBufferStorage is immutable, so growing means a new buffer.
+static void draw_ring_create(int capacity)
+{
+    draw_ring_destroy();
+
+    if(vbo_capacity > 0)
+    {
+        GL_CALL(glDeleteBuffers(1, &vbo));
+        GL_CALL(glGenBuffers(1, &vbo));
+    }
+
+    vbo_capacity = capacity;
+    ring.segment_size = vbo_capacity*sizeof(DrawRect);
+    ring.segment = 0;
+
+    size_t total_size = ring.segment_size*DRAW_RING_SEGMENTS;
+
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+
+    ring.persistent = GLEW_ARB_buffer_storage;
+
+    if(ring.persistent)
+    {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        GL_CALL(glBufferStorage(GL_ARRAY_BUFFER, total_size, NULL, flags));
+        ring.mapped = (U8*)GL_CALL(glMapBufferRange(GL_ARRAY_BUFFER, 0, total_size, flags));
 
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
-    glDisableVertexAttribArray(2);
-    glDisableVertexAttribArray(3);
-    glDisableVertexAttribArray(4);
-    glDisableVertexAttribArray(5);
-    glDisableVertexAttribArray(6);
-    glDisableVertexAttribArray(7);
-    glDisableVertexAttribArray(8);
-    glDisableVertexAttribArray(9);
-    glDisableVertexAttribArray(10);
+        if(!ring.mapped)
+        {
+            logw("Failed to persistently map vbo, falling back to glMapBufferRange");
+            ring.persistent = false;
+
+            GL_CALL(glDeleteBuffers(1, &vbo));
+            GL_CALL(glGenBuffers(1, &vbo));
+            GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+        }
+    }
+
+    if(!ring.persistent)
+    {
+        GL_CALL(glBufferData(GL_ARRAY_BUFFER, total_size, NULL, GL_STREAM_DRAW));
+    }
+
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+    logi("Draw ring: %d x %d rects (%s)", DRAW_RING_SEGMENTS, vbo_capacity, ring.persistent ? "persistent" : "map range");
+}
+
+// blocks until the gpu is done reading from the segment we're about to write.
+// with 3 segments this almost never actually waits.
+static void draw_ring_wait(int segment)
+{
+    GLsync fence = ring.fences[segment];
+    if(!fence)
+        return;
+
+    for(;;)
+    {
+        GLenum res = GL_CALL(glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000)); // 1ms
+        if(res == GL_ALREADY_SIGNALED || res == GL_CONDITION_SATISFIED || res == GL_WAIT_FAILED)
+            break;
+    }
+
+    GL_CALL(glDeleteSync(fence));
+    ring.fences[segment] = 0;
+}
+
+void draw_init()
+{
+    logi("GL version: %s",glGetString(GL_VERSION));
+
+    draw_list_main = draw_list_create();
+
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    glGenBuffers(1, &vbo);
+    draw_ring_create(DRAW_CHUNK_RECTS);
+
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    draw_set_attribs(0);
 
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // uniforms that never change are set once here
+    for(int i = 0; i < SHADER_BASIC_VARIANT_COUNT; ++i)
+    {
+        DrawPipeline* p = &draw_pipelines[i];
+        p->program = basic_programs[i];
+
+        p->loc_res = glGetUniformLocation(p->program, "res");
+        p->loc_atlas = glGetUniformLocation(p->program, "atlas");
+
+        p->loc_verts[0] = glGetUniformLocation(p->program, "verts[0]");
+        p->loc_verts[1] = glGetUniformLocation(p->program, "verts[1]");
+        p->loc_verts[2] = glGetUniformLocation(p->program, "verts[2]");
+        p->loc_verts[3] = glGetUniformLocation(p->program, "verts[3]");
+
+        glUseProgram(p->program);
+        glUniform1i(p->loc_atlas, 0);
+        glUniform2f(p->loc_verts[0], -1.0, -1.0);
+        glUniform2f(p->loc_verts[1], -1.0, +1.0);
+        glUniform2f(p->loc_verts[2], +1.0, -1.0);
+        glUniform2f(p->loc_verts[3], +1.0, +1.0);
+    }
     glUseProgram(0);
+
+    logi("Draw pipelines: %d, base instance: %s", SHADER_BASIC_VARIANT_COUNT, GLEW_ARB_base_instance ? "yes" : "no");
+
+    glGenQueries(2*DRAW_GPU_QUERIES, &gpu_timer.queries[0][0]);
+
+    atlas_init();
+    load_font();
+    image_init();
+}
+
+// the clear is deferred to draw_commit so it can be skipped along with the rest of the frame
+void draw_clear_screen(float r, float g, float b)
+{
+    clear_color.x = r;
+    clear_color.y = g;
+    clear_color.z = b;
+    clear_color.w = 0.0;
+}
+
+// queues the rect as up to 5 instances that all keep the full rect and only
+// differ by clip: a flat interior where the sdf is known to be fully
+// covered, and the 4 bands around it which still run the sdf. Bordered
+// rects are empty inside and skip the interior. The interior is only split
+// off opaque rects, it goes to the depth pre-pass then. A translucent one
+// would be a sharp instance in the middle of the blended runs
+static bool draw_rect_split(DrawList* list, DrawRect* rect)
+{
+    bool opaque = rect->color1.a == 255 && rect->color2.a == 255;
+    if(rect->border_thickness == 0 && !opaque)
+        return false;
+
+    float inset_px = rect->corner_radius +
+                     2.0f*rect->edge_softness/DRAW_SOFTNESS_SCALE +
+                     rect->border_thickness/DRAW_BORDER_SCALE;
+
+    I32 inset = (I32)ceilf(inset_px*DRAW_POS_SCALE);
+
+    I32 x0 = rect->p0[0], y0 = rect->p0[1];
+    I32 x1 = rect->p1[0], y1 = rect->p1[1];
+    I32 ix0 = x0 + inset, iy0 = y0 + inset;
+    I32 ix1 = x1 - inset, iy1 = y1 - inset;
+
+    const I32 min_size = (I32)(DRAW_SPLIT_MIN_SIZE*DRAW_POS_SCALE);
+    if(ix1 - ix0 < min_size || iy1 - iy0 < min_size)
+        return false;
+
+    I32 regions[5][4] = {
+        {ix0, iy0, ix1, iy1}, // interior
+        {x0,  y0,  x1,  iy0}, // top
+        {x0,  iy1, x1,  y1},  // bottom
+        {x0,  iy0, ix0, iy1}, // left
+        {ix1, iy0, x1,  iy1}, // right
+    };
+
+    for(int i = (rect->border_thickness > 0) ? 1 : 0; i < 5; ++i)
+    {
+        DrawClip clip;
+        clip.p0[0] = (I16)MAX(regions[i][0], rect->clip_p0[0]);
+        clip.p0[1] = (I16)MAX(regions[i][1], rect->clip_p0[1]);
+        clip.p1[0] = (I16)MIN(regions[i][2], rect->clip_p1[0]);
+        clip.p1[1] = (I16)MIN(regions[i][3], rect->clip_p1[1]);
+
+        if(clip.p1[0] <= clip.p0[0] || clip.p1[1] <= clip.p0[1])
+            continue;
+
+        DrawRect* r = draw_push_rect(list);
+        *r = *rect;
+        memcpy(r->clip_p0, &clip, sizeof(DrawClip));
+
+        if(i == 0)
+            r->pipeline = SHADER_BASIC_RECT_SHARP;
+    }
+
+    return true;
+}
+
+void draw_rect_full(float x, float y, float w, float h, Vec4f color1, Vec4f color2, bool gradient_horizontal, float border_thickness, float corner_radius, float edge_softness)
+{
+    DrawList* list = draw_get_list();
+
+    I16 x0 = draw_quantize_pos(x);
+    I16 y0 = draw_quantize_pos(y);
+    I16 x1 = draw_quantize_pos(x+w);
+    I16 y1 = draw_quantize_pos(y+h);
+
+    if(draw_clip_rejects(list, x0, y0, x1, y1))
+        return;
+
+    DrawRect rect = {0};
+
+    rect.p0[0] = x0;
+    rect.p0[1] = y0;
+    rect.p1[0] = x1;
+    rect.p1[1] = y1;
+
+    rect.color1 = draw_pack_color(color1);
+    rect.color2 = draw_pack_color(color2);
+
+    rect.corner_radius = draw_quantize_style(corner_radius, 1.0f);
+    rect.edge_softness = draw_quantize_style(edge_softness, DRAW_SOFTNESS_SCALE);
+    rect.border_thickness = draw_quantize_style(border_thickness, DRAW_BORDER_SCALE);
+
+    if(memcmp(&rect.color1, &rect.color2, sizeof(Color)) != 0)
+        rect.flags |= (gradient_horizontal ? DRAW_FLAG_GRADIENT_H : DRAW_FLAG_GRADIENT_V);
+
+    memcpy(rect.clip_p0, &list->clip_current, sizeof(DrawClip));
+
+    if(rect.border_thickness > 0)
+        rect.pipeline = SHADER_BASIC_RECT_BORDER;
+    else if(rect.corner_radius == 0 && rect.edge_softness == 0)
+        rect.pipeline = SHADER_BASIC_RECT_SHARP;
+    else
+        rect.pipeline = SHADER_BASIC_RECT_ROUNDED;
+
+    if(split_rects && rect.pipeline != SHADER_BASIC_RECT_SHARP && draw_rect_split(list, &rect))
+        return;
+
+    *draw_push_rect(list) = rect;
+}
+
+void draw_rect(float x, float y, float w, float h, Vec4f color)
+{
+    DrawList* list = draw_get_list();
+    draw_rect_full(x, y, w, h, color, color, true, 0.0, list->corner_radius, list->edge_softness);
+}
+
+void draw_rect_frame(float x, float y, float w, float h, Vec4f color, float border_thickness)
+{
+    DrawList* list = draw_get_list();
+    draw_rect_full(x, y, w, h, color, color, true, border_thickness, list->corner_radius, list->edge_softness);
+}
+
+void draw_rect_hgrad(float x, float y, float w, float h, Vec4f color1, Vec4f color2)
+{
+    DrawList* list = draw_get_list();
+    draw_rect_full(x, y, w, h, color1, color2, true, 0.0, list->corner_radius, list->edge_softness);
+}
+
+void draw_rect_vgrad(float x, float y, float w, float h, Vec4f color1, Vec4f color2)
+{
+    DrawList* list = draw_get_list();
+    draw_rect_full(x, y, w, h, color1, color2, false, 0.0, list->corner_radius, list->edge_softness);
+}
+
+void draw_set_rect_corner_radius(float r)
+{
+    draw_get_list()->corner_radius = r;
+}
+void draw_set_rect_edge_softness(float v)
+{
+    draw_get_list()->edge_softness = v;
+}
+void draw_set_split_rects(bool split)
+{
+    split_rects = split;
+}
+void draw_set_line_cap(DrawLineCap cap)
+{
+    draw_get_list()->line_cap = cap;
+}
+
+// queues a shape instance over the bounding box (x0,y0)-(x1,y1)
+static void draw_shape(DrawList* list, float x0, float y0, float x1, float y1, U16 thickness, U8 flags, Vec4f color)
+{
+    I16 qx0 = draw_quantize_pos(x0);
+    I16 qy0 = draw_quantize_pos(y0);
+    I16 qx1 = draw_quantize_pos(x1);
+    I16 qy1 = draw_quantize_pos(y1);
+
+    if(draw_clip_rejects(list, qx0, qy0, qx1, qy1))
+        return;
+
+    DrawRect* rect = draw_push_rect(list);
+    memset(rect, 0, sizeof(DrawRect));
+
+    rect->p0[0] = qx0;
+    rect->p0[1] = qy0;
+    rect->p1[0] = qx1;
+    rect->p1[1] = qy1;
+
+    rect->color1 = draw_pack_color(color);
+    rect->color2 = rect->color1;
+
+    rect->edge_softness = draw_quantize_style(list->edge_softness, DRAW_SOFTNESS_SCALE);
+    rect->corner_radius = (U8)(thickness >> 8);
+    rect->border_thickness = (U8)(thickness & 0xFF);
+    rect->flags = flags;
+
+    memcpy(rect->clip_p0, &list->clip_current, sizeof(DrawClip));
+
+    rect->pipeline = SHADER_BASIC_SHAPE;
+}
+
+static void draw_line_cap(DrawList* list, float x0, float y0, float x1, float y1, float thickness, DrawLineCap cap, Vec4f color)
+{
+    U16 quantized = draw_quantize_thickness(thickness);
+    if(quantized == 0)
+        return;
+
+    // the shader puts the end points half the thickness into the corners
+    float r = 0.5f*quantized/DRAW_BORDER_SCALE;
+
+    if(cap == DRAW_LINE_CAP_SQUARE)
+    {
+        float dx = x1 - x0;
+        float dy = y1 - y0;
+        float len = sqrtf(dx*dx + dy*dy);
+
+        if(len > 0.0f)
+        {
+            x0 -= dx/len*r; y0 -= dy/len*r;
+            x1 += dx/len*r; y1 += dy/len*r;
+        }
+    }
+
+    U8 flags = DRAW_FLAG_LINE;
+    if(cap != DRAW_LINE_CAP_ROUND)
+        flags |= DRAW_FLAG_LINE_BUTT;
+
+    // one end in the top left and the other in the bottom right corner,
+    // or flipped to the other diagonal
+    if((x1 < x0) != (y1 < y0))
+        flags |= DRAW_FLAG_LINE_FLIP;
+
+    draw_shape(list, MIN(x0, x1) - r, MIN(y0, y1) - r, MAX(x0, x1) + r, MAX(y0, y1) + r, quantized, flags, color);
+}
+
+void draw_line(float x0, float y0, float x1, float y1, float thickness, Vec4f color)
+{
+    DrawList* list = draw_get_list();
+    draw_line_cap(list, x0, y0, x1, y1, thickness, list->line_cap, color);
+}
+
+// one segment instance per edge, joined by their round caps
+void draw_polyline(Vec2f* points, int count, float thickness, Vec4f color)
+{
+    DrawList* list = draw_get_list();
+
+    for(int i = 0; i+1 < count; ++i)
+        draw_line_cap(list, points[i].x, points[i].y, points[i+1].x, points[i+1].y, thickness, DRAW_LINE_CAP_ROUND, color);
+}
+
+void draw_circle(float cx, float cy, float radius, Vec4f color)
+{
+    draw_shape(draw_get_list(), cx - radius, cy - radius, cx + radius, cy + radius, 0, DRAW_FLAG_CIRCLE, color);
+}
+
+void draw_ring(float cx, float cy, float radius, float thickness, Vec4f color)
+{
+    U16 quantized = draw_quantize_thickness(thickness);
+    if(quantized == 0)
+        return;
+
+    draw_shape(draw_get_list(), cx - radius, cy - radius, cx + radius, cy + radius, quantized, DRAW_FLAG_CIRCLE, color);
+}
+
+void draw_push_clip(float x, float y, float w, float h)
+{
+    DrawList* list = draw_get_list();
+
+    if(list->clip_count >= DRAW_CLIP_STACK_MAX)
+    {
+        logw("Hit clip stack max, failed to push clip rect");
+        return;
+    }
+
+    DrawClip* clip = &list->clip_current;
+    list->clip_stack[list->clip_count++] = *clip;
+
+    clip->p0[0] = MAX(clip->p0[0], draw_quantize_pos(x));
+    clip->p0[1] = MAX(clip->p0[1], draw_quantize_pos(y));
+    clip->p1[0] = MIN(clip->p1[0], draw_quantize_pos(x+w));
+    clip->p1[1] = MIN(clip->p1[1], draw_quantize_pos(y+h));
+}
+
+void draw_pop_clip()
+{
+    DrawList* list = draw_get_list();
+
+    if(list->clip_count <= 0)
+    {
+        logw("Clip stack underflow");
+        return;
+    }
+
+    list->clip_current = list->clip_stack[--list->clip_count];
+}
+
+void draw_set_layer(U8 layer)
+{
+    DrawList* list = draw_get_list();
+    list->sort_bits = (list->sort_bits & 0x00FFFFFF) | ((U32)layer << 24);
+}
+
+U8 draw_get_layer()
+{
+    return (U8)(draw_get_list()->sort_bits >> 24);
+}
+
+void draw_set_z(U16 z)
+{
+    DrawList* list = draw_get_list();
+    list->sort_bits = (list->sort_bits & 0xFF0000FF) | ((U32)z << 8);
+}
+
+// with regrouping on, instances in the same layer and z are also sorted by
+// pipeline and texture so they batch together. Only for content that doesn't
+// overlap within a layer and z, since it no longer draws in call order
+void draw_set_regroup(bool regroup)
+{
+    DrawList* list = draw_get_list();
+    list->sort_bits = (list->sort_bits & ~DRAW_SORT_REGROUP) | (regroup ? DRAW_SORT_REGROUP : 0);
+}
+
+void draw_image(float x, float y, float w, float h, AtlasRegion* image, Vec4f tint)
+{
+    DrawList* list = draw_get_list();
+
+    I16 x0 = draw_quantize_pos(x);
+    I16 y0 = draw_quantize_pos(y);
+    I16 x1 = draw_quantize_pos(x+w);
+    I16 y1 = draw_quantize_pos(y+h);
+
+    if(draw_clip_rejects(list, x0, y0, x1, y1))
+        return;
+
+    DrawRect* rect = draw_push_rect(list);
+    memset(rect, 0, sizeof(DrawRect));
+
+    rect->p0[0] = x0;
+    rect->p0[1] = y0;
+    rect->p1[0] = x1;
+    rect->p1[1] = y1;
+
+    rect->tex_p0[0] = draw_quantize_uv(image->u0);
+    rect->tex_p0[1] = draw_quantize_uv(image->v0);
+    rect->tex_p1[0] = draw_quantize_uv(image->u1);
+    rect->tex_p1[1] = draw_quantize_uv(image->v1);
+
+    rect->color1 = draw_pack_color(tint);
+    rect->color2 = rect->color1;
+
+    rect->flags = DRAW_FLAG_IMAGE;
+
+    memcpy(rect->clip_p0, &list->clip_current, sizeof(DrawClip));
+
+    rect->layer = (U8)image->layer;
+    rect->pipeline = SHADER_BASIC_IMAGE;
+}
+
+// w,h
+// sum of the advances of n ascii chars, in font units
+static float font_advance_sum_ascii(const U8* s, int n)
+{
+    float sum = 0.0;
+    int i = 0;
+
+#if defined(__AVX2__)
+    __m256 acc = _mm256_setzero_ps();
+    for(; i+8 <= n; i += 8)
+    {
+        __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(s+i)));
+        acc = _mm256_add_ps(acc, _mm256_i32gather_ps(font_advances, idx, 4));
+    }
+
+    float lanes[8];
+    _mm256_storeu_ps(lanes, acc);
+    for(int l = 0; l < 8; ++l)
+        sum += lanes[l];
+#elif defined(__SSE2__)
+    // no gather before AVX2, the 4 lanes still split the chain of dependent adds
+    __m128 acc = _mm_setzero_ps();
+    for(; i+4 <= n; i += 4)
+        acc = _mm_add_ps(acc, _mm_set_ps(font_advances[s[i+3]], font_advances[s[i+2]], font_advances[s[i+1]], font_advances[s[i]]));
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+
+    for(; i < n; ++i)
+        sum += font_advances[s[i]];
+
+    return sum;
+}
+
+// kerning between the chars of n bytes of utf-8, in font units. A pass of
+// its own so the advances keep the vector path, and only chars that start
+// a pair are looked up
+static float font_kerning_sum(const U8* s, int n)
+{
+    float sum = 0.0;
+    U32 prev = 0;
+
+    for(int i = 0; i < n;)
+    {
+        int ascii = utf8_ascii_prefix((const char*)s+i, n-i);
+        if(ascii > 0)
+        {
+            // skipped whole if nothing baked kerns
+            if(font_kerning.has_baked)
+            {
+                for(int end = i + ascii; i < end; ++i)
+                {
+                    U32 id = font_chars[s[i]].kern_id;
+                    sum += font_kerning_get(prev, id);
+                    prev = id;
+                }
+            }
+            else
+            {
+                i += ascii;
+                prev = font_chars[s[i-1]].kern_id;
+            }
+
+            continue;
+        }
+
+        U32 id;
+        glyph_atlas_get_advance(utf8_decode((const char*)s, n, &i), &id);
+
+        sum += font_kerning_get(prev, id);
+        prev = id;
+    }
+
+    return sum;
+}
+
+// sum of the advances of n bytes of utf-8, kerning included, in font
+// units. ascii spans take the vector path, only the code points between
+// them are decoded
+static float font_advance_sum(const U8* s, int n)
+{
+    float sum = 0.0;
+
+    for(int i = 0; i < n;)
+    {
+        int ascii = utf8_ascii_prefix((const char*)s+i, n-i);
+        sum += font_advance_sum_ascii(s+i, ascii);
+        i += ascii;
+
+        if(i < n)
+        {
+            U32 id;
+            sum += glyph_atlas_get_advance(utf8_decode((const char*)s, n, &i), &id);
+        }
+    }
+
+    if(font_kerning.count > 0)
+        sum += font_kerning_sum(s, n);
+
+    return sum;
+}
+
+// unscaled size of str, cached by content
+static MeasureEntry* string_measure(char* str, int len)
+{
+    U64 hash = hash_mix64(hash_bytes(HASH_SEED ^ font_generation, str, len));
+    MeasureEntry* entry = &measure_cache[hash & (MEASURE_CACHE_SIZE-1)];
+
+    if(entry->hash == hash && entry->len == len)
+        return entry;
+
+    float longest_width = 0.0;
+    int num_lines = 1;
+
+    char* line = str;
+    char* end = str+len;
+
+    for(;;)
+    {
+        char* nl = (line < end) ? memchr(line, '\n', end-line) : NULL;
+        char* line_end = nl ? nl : end;
+
+        float width = font_advance_sum((const U8*)line, line_end-line);
+        if(width > longest_width)
+            longest_width = width;
+
+        if(!nl)
+            break;
+
+        num_lines++;
+        line = nl+1;
+    }
+
+    entry->hash = hash;
+    entry->len = len;
+    entry->width = longest_width;
+    entry->lines = num_lines;
+
+    return entry;
+}
+
+Vec2f text_get_size(float scale, String s)
+{
+    float fontsize = 64.0 * scale;
+    MeasureEntry* m = string_measure(s.data, s.len);
+
+    Vec2f ret = {fontsize*m->width, fontsize*m->lines};
+    return ret;
+}
+
+Vec2f string_get_size(float scale, char* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    String str = StringFormatV(draw_get_list()->frame_arena, fmt, args);
+    va_end(args);
+
+    return text_get_size(scale, str);
+}
+
+// measures count strings at once, for sizing many boxes in one go
+void string_get_sizes(float scale, String* strings, int count, Vec2f* sizes)
+{
+    float fontsize = 64.0 * scale;
+
+    for(int i = 0; i < count; ++i)
+    {
+        MeasureEntry* m = string_measure(strings[i].data, strings[i].len);
+
+        sizes[i].x = fontsize*m->width;
+        sizes[i].y = fontsize*m->lines;
+    }
+}
+
+static void glyph_cache_lru_unlink(GlyphCache* cache, GlyphRun* run)
+{
+    if(run->lru_prev) run->lru_prev->lru_next = run->lru_next;
+    else cache->lru_first = run->lru_next;
+
+    if(run->lru_next) run->lru_next->lru_prev = run->lru_prev;
+    else cache->lru_last = run->lru_prev;
+
+    run->lru_prev = NULL;
+    run->lru_next = NULL;
+}
+
+static void glyph_cache_lru_push_front(GlyphCache* cache, GlyphRun* run)
+{
+    run->lru_prev = NULL;
+    run->lru_next = cache->lru_first;
+
+    if(cache->lru_first) cache->lru_first->lru_prev = run;
+    cache->lru_first = run;
+
+    if(!cache->lru_last) cache->lru_last = run;
+}
+
+static void glyph_cache_evict(GlyphCache* cache, GlyphRun* run)
+{
+    GlyphRun** slot = &cache->buckets[run->hash & (GLYPH_CACHE_BUCKETS-1)];
+    while(*slot != run)
+        slot = &(*slot)->hash_next;
+    *slot = run->hash_next;
+
+    glyph_cache_lru_unlink(cache, run);
+    cache->bytes -= run->bytes;
+    free(run);
+}
+
+// lays out the visible glyphs of str relative to (0,0), refs gets the
+// runtime glyph cells used. returns false if the string doesn't fit the
+// fixed point range relative to its origin
+static bool glyph_run_layout(char* str, int len, float scale, DrawRect* glyphs, int* glyph_count, FontCellRef* refs, int* ref_count)
+{
+    const float limit = 32767.0f/DRAW_POS_SCALE;
+
+    float fontsize = 64.0 * scale;
+
+    float x_pos = 0.0;
+    float y_pos = fontsize;
+
+    int n = 0;
+    int r = 0;
+    U32 prev = 0;
+
+    for(int i = 0; i < len;)
+    {
+        if(str[i] == '\n')
+        {
+            y_pos += fontsize;
+            x_pos = 0.0;
+            prev = 0;
+            i++;
+            continue;
+        }
+
+        FontChar tmp;
+        FontCellRef ref;
+        U8 layer;
+        FontChar* fc = font_next_char(str, len, &i, &tmp, &layer, &ref);
+
+        if(ref.cell >= 0)
+            refs[r++] = ref;
+
+        x_pos += fontsize*font_kerning_get(prev, fc->kern_id);
+        prev = fc->kern_id;
+
+        float x0 = x_pos + fontsize*fc->plane_box.l;
+        float y0 = y_pos - fontsize*fc->plane_box.t;
+        float x1 = x_pos + fontsize*fc->plane_box.r;
+        float y1 = y_pos - fontsize*fc->plane_box.b;
+
+        x_pos += (fontsize*fc->advance);
+
+        // nothing to draw (e.g. space)
+        if(x1 <= x0 || y1 <= y0)
+            continue;
+
+        if(ABSF(x0) > limit || ABSF(x1) > limit || ABSF(y0) > limit || ABSF(y1) > limit)
+            return false;
+
+        DrawRect* g = &glyphs[n++];
+        memset(g, 0, sizeof(DrawRect));
+
+        g->p0[0] = draw_quantize_pos(x0);
+        g->p0[1] = draw_quantize_pos(y0);
+        g->p1[0] = draw_quantize_pos(x1);
+        g->p1[1] = draw_quantize_pos(y1);
+
+        g->tex_p0[0] = draw_quantize_uv(fc->tex_coords.l);
+        g->tex_p0[1] = draw_quantize_uv(fc->tex_coords.t);
+        g->tex_p1[0] = draw_quantize_uv(fc->tex_coords.r);
+        g->tex_p1[1] = draw_quantize_uv(fc->tex_coords.b);
+
+        g->flags = DRAW_FLAG_TEXTURED;
+        g->layer = layer;
+        g->pipeline = SHADER_BASIC_TEXT;
+    }
+
+    *glyph_count = n;
+    *ref_count = r;
+    return true;
+}
+
+// returns the cached run for str, laying it out on a miss.
+// NULL if the string can't be cached
+static GlyphRun* glyph_cache_get(GlyphCache* cache, char* str, int len, float scale)
+{
+    U64 hash = hash_bytes(HASH_SEED, str, len);
+    hash = hash_mix64(hash_bytes(hash, &scale, sizeof(scale)));
+
+    GlyphRun** bucket = &cache->buckets[hash & (GLYPH_CACHE_BUCKETS-1)];
+
+    for(GlyphRun* run = *bucket; run; run = run->hash_next)
+    {
+        if(run->hash != hash || run->len != len || run->scale != scale)
+            continue;
+
+        if(run->font_generation != font_generation || memcmp(run->str, str, len) != 0)
+            continue;
+
+        // a runtime glyph it uses was replaced, lay it out again
+        if(run->ref_count > 0 && !glyph_atlas_touch_refs(run->refs, run->ref_count))
+        {
+            glyph_cache_evict(cache, run);
+            break;
+        }
+
+        glyph_cache_lru_unlink(cache, run);
+        glyph_cache_lru_push_front(cache, run);
+        return run;
+    }
+
+    // every char produces at most one glyph, only non ascii ones use cells
+    int non_ascii = 0;
+    for(int i = utf8_ascii_prefix(str, len); i < len; ++i)
+        non_ascii += ((U8)str[i] >> 7);
+
+    size_t bytes = sizeof(GlyphRun) + len*sizeof(DrawRect) + non_ascii*sizeof(FontCellRef) + len;
+    if(bytes > GLYPH_CACHE_MAX_BYTES/8)
+        return NULL;
+
+    GlyphRun* run = (GlyphRun*)malloc(bytes);
+    run->glyphs = (DrawRect*)(run+1);
+    run->refs = (FontCellRef*)(run->glyphs + len);
+    run->str = (char*)(run->refs + non_ascii);
+
+    if(!glyph_run_layout(str, len, scale, run->glyphs, &run->glyph_count, run->refs, &run->ref_count))
+    {
+        free(run);
+        return NULL;
+    }
+
+    memcpy(run->str, str, len);
+    run->len = len;
+    run->hash = hash;
+    run->scale = scale;
+    run->font_generation = font_generation;
+    run->bytes = bytes;
+
+    while(cache->lru_last && cache->bytes + bytes > GLYPH_CACHE_MAX_BYTES)
+        glyph_cache_evict(cache, cache->lru_last);
+
+    run->hash_next = *bucket;
+    *bucket = run;
+    glyph_cache_lru_push_front(cache, run);
+    cache->bytes += bytes;
+
+    return run;
+}
+
+// copies the run's glyphs into the queue, translated to (x,y)
+static void draw_glyph_run(DrawList* list, GlyphRun* run, float x, float y, Color color)
+{
+    I32 ox = draw_quantize_pos(x);
+    I32 oy = draw_quantize_pos(y);
+
+    for(int i = 0; i < run->glyph_count; ++i)
+    {
+        DrawRect* g = &run->glyphs[i];
+
+        I16 x0 = (I16)CLAMP(ox + g->p0[0], INT16_MIN, INT16_MAX);
+        I16 y0 = (I16)CLAMP(oy + g->p0[1], INT16_MIN, INT16_MAX);
+        I16 x1 = (I16)CLAMP(ox + g->p1[0], INT16_MIN, INT16_MAX);
+        I16 y1 = (I16)CLAMP(oy + g->p1[1], INT16_MIN, INT16_MAX);
+
+        if(draw_clip_rejects(list, x0, y0, x1, y1))
+            continue;
+
+        DrawRect* rect = draw_push_rect(list);
+        *rect = *g;
+
+        rect->p0[0] = x0;
+        rect->p0[1] = y0;
+        rect->p1[0] = x1;
+        rect->p1[1] = y1;
+
+        rect->color1 = color;
+        rect->color2 = color;
+
+        memcpy(rect->clip_p0, &list->clip_current, sizeof(DrawClip));
+    }
+}
+
+// lays out and queues the glyphs directly, for strings that can't be cached
+static void draw_glyphs(DrawList* list, char* str, int len, float x, float y, float scale, Color color)
+{
+    float fontsize = 64.0 * scale;
+
+    float x_pos = x;
+    float y_pos = y+fontsize;
+    U32 prev = 0;
+
+    for(int i = 0; i < len;)
+    {
+        if(str[i] == '\n')
+        {
+            y_pos += fontsize;
+            x_pos = x;
+            prev = 0;
+            i++;
+            continue;
+        }
+
+        FontChar tmp;
+        FontCellRef ref;
+        U8 layer;
+        FontChar* fc = font_next_char(str, len, &i, &tmp, &layer, &ref);
+
+        x_pos += fontsize*font_kerning_get(prev, fc->kern_id);
+        prev = fc->kern_id;
+
+        I16 x0 = draw_quantize_pos(x_pos + fontsize*fc->plane_box.l);
+        I16 y0 = draw_quantize_pos(y_pos - fontsize*fc->plane_box.t);
+        I16 x1 = draw_quantize_pos(x_pos + fontsize*fc->plane_box.r);
+        I16 y1 = draw_quantize_pos(y_pos - fontsize*fc->plane_box.b);
+
+        x_pos += (fontsize*fc->advance);
+
+        if(draw_clip_rejects(list, x0, y0, x1, y1))
+            continue;
+
+        DrawRect* rect = draw_push_rect(list);
+        memset(rect, 0, sizeof(DrawRect));
+
+        rect->p0[0] = x0;
+        rect->p0[1] = y0;
+        rect->p1[0] = x1;
+        rect->p1[1] = y1;
+
+        rect->tex_p0[0] = draw_quantize_uv(fc->tex_coords.l);
+        rect->tex_p0[1] = draw_quantize_uv(fc->tex_coords.t);
+        rect->tex_p1[0] = draw_quantize_uv(fc->tex_coords.r);
+        rect->tex_p1[1] = draw_quantize_uv(fc->tex_coords.b);
+
+        rect->color1 = color;
+        rect->color2 = color;
+
+        rect->flags = DRAW_FLAG_TEXTURED;
+
+        memcpy(rect->clip_p0, &list->clip_current, sizeof(DrawClip));
+
+        rect->layer = layer;
+        rect->pipeline = SHADER_BASIC_TEXT;
+    }
+}
+
+void draw_text(float x, float y, float scale, Vec4f color, String s)
+{
+    if(s.len == 0)
+        return;
+
+    DrawList* list = draw_get_list();
+    Color packed_color = draw_pack_color(color);
+
+    GlyphRun* run = glyph_cache_get(&list->glyph_cache, s.data, s.len, scale);
+
+    if(run)
+        draw_glyph_run(list, run, x, y, packed_color);
+    else
+        draw_glyphs(list, s.data, s.len, x, y, scale, packed_color);
+}
+
+void draw_string(float x, float y, float scale, Vec4f color, char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    String str = StringFormatV(draw_get_list()->frame_arena, format, args);
+    va_end(args);
+
+    draw_text(x, y, scale, color, str);
+}
+
+void draw_list_destroy(DrawList* list)
+{
+    if(!list || list == draw_list_main)
+        return;
+
+    pthread_mutex_lock(&draw_lists_mutex);
+
+    for(int i = 0; i < draw_list_count; ++i)
+    {
+        if(draw_lists[i] != list)
+            continue;
+
+        // keep the order of the remaining lists
+        memmove(&draw_lists[i], &draw_lists[i+1], (draw_list_count-i-1)*sizeof(DrawList*));
+        draw_list_count--;
+        break;
+    }
+
+    pthread_mutex_unlock(&draw_lists_mutex);
+
+    while(list->glyph_cache.lru_last)
+        glyph_cache_evict(&list->glyph_cache, list->glyph_cache.lru_last);
+
+    arena_destroy(list->arena);
+    arena_destroy(list->frame_arena);
+    free(list);
+}
+
+// sets the list the calling thread records into, NULL for the main list
+void draw_set_list(DrawList* list)
+{
+    draw_list_current = list;
+}
+
+static void draw_gpu_timer_poll()
+{
+    while(gpu_timer.pending > 0)
+    {
+        int oldest = (gpu_timer.head - gpu_timer.pending + DRAW_GPU_QUERIES) % DRAW_GPU_QUERIES;
+
+        // the end query completes last
+        GLint available = 0;
+        GL_CALL(glGetQueryObjectiv(gpu_timer.queries[oldest][1], GL_QUERY_RESULT_AVAILABLE, &available));
+        if(!available)
+            break;
+
+        GLuint64 start = 0, end = 0;
+        GL_CALL(glGetQueryObjectui64v(gpu_timer.queries[oldest][0], GL_QUERY_RESULT, &start));
+        GL_CALL(glGetQueryObjectui64v(gpu_timer.queries[oldest][1], GL_QUERY_RESULT, &end));
+
+        gpu_timer.ms = (end - start) / 1000000.0;
+        gpu_timer.has_result = true;
+        gpu_timer.pending--;
+    }
+}
+
+bool draw_take_gpu_time(double* ms)
+{
+    draw_gpu_timer_poll();
+
+    if(!gpu_timer.has_result)
+        return false;
+
+    *ms = gpu_timer.ms;
+    gpu_timer.has_result = false;
+    return true;
+}
+
+void draw_invalidate()
+{
+    frame_dirty = true;
+}
+
+DrawStats draw_get_stats()
+{
+    return draw_stats;
+}
+
+// hash of everything that ends up in the frame: the instance stream, which
+// draw_push_rect() hashes as it's written, and the state feeding the
+// uniforms, clear and viewport
+static U64 draw_hash_frame()
+{
+    U64 h = HASH_SEED;
+
+    for(int i = 0; i < draw_list_count; ++i)
+    {
+        DrawList* list = draw_lists[i];
+
+        draw_hash_pending(list);
+        h = hash_bytes(h, &list->hash, sizeof(list->hash));
+    }
+
+    int state[] = {
+        scale_view,
+        view_width, view_height,
+        window_width, window_height,
+        atlas.texture, atlas.generation
+    };
+
+    h = hash_bytes(h, state, sizeof(state));
+    h = hash_bytes(h, &clear_color, sizeof(clear_color));
+
+    return hash_mix64(h);
+}
+
+static void draw_get_resolution(int* w, int* h)
+{
+    if(scale_view)
+    {
+        *w = view_width;
+        *h = view_height;
+    }
+    else
+    {
+        *w = window_width;
+        *h = window_height;
+    }
+}
+
+// concatenates the lists into draw_order, also counts rect_count
+static void draw_build_order()
+{
+    rect_count = 0;
+    for(int i = 0; i < draw_list_count; ++i)
+        rect_count += draw_lists[i]->rect_count;
+
+    if(draw_order_capacity < rect_count)
+    {
+        draw_order_capacity = MAX(rect_count, 2*draw_order_capacity);
+        draw_order = (DrawRect**)realloc(draw_order, draw_order_capacity*sizeof(DrawRect*));
+        draw_order_tmp = (DrawRect**)realloc(draw_order_tmp, draw_order_capacity*sizeof(DrawRect*));
+        draw_keys = (U64*)realloc(draw_keys, draw_order_capacity*sizeof(U64));
+        draw_keys_tmp = (U64*)realloc(draw_keys_tmp, draw_order_capacity*sizeof(U64));
+    }
+
+    int n = 0;
+    for(int l = 0; l < draw_list_count; ++l)
+    {
+        DrawList* list = draw_lists[l];
+
+        for(DrawChunk* chunk = list->chunk_first; chunk; chunk = chunk->next)
+        {
+            for(int i = 0; i < chunk->count; ++i)
+            {
+                DrawRect* r = &chunk->rects[i];
+                U32 sort = chunk->sort[i];
+
+                // layer:8 | z:16 | pipeline:8 | texture:8 | unused:24
+                U64 key = (U64)(sort >> 8) << 40;
+
+                if(sort & DRAW_SORT_REGROUP)
+                {
+                    key |= ((U64)r->pipeline << 32) | ((U64)r->layer << 24);
+                }
+
+                draw_order[n] = r;
+                draw_keys[n] = key;
+                n++;
+            }
+
+            if(chunk == list->chunk_current)
+                break;
+        }
+    }
+}
+
+// stable LSD radix sort of draw_order by draw_keys, one pass per byte.
+// bytes that are the same in every key are skipped, so a frame that uses
+// neither layers, z nor regrouping isn't sorted at all
+static void draw_sort_order()
+{
+    U64 key_or = 0;
+    U64 key_and = ~0ull;
+
+    for(int i = 0; i < rect_count; ++i)
+    {
+        key_or |= draw_keys[i];
+        key_and &= draw_keys[i];
+    }
+
+    U64 varying = key_or ^ key_and;
+
+    U64* keys = draw_keys;
+    U64* keys_dst = draw_keys_tmp;
+    DrawRect** order = draw_order;
+    DrawRect** order_dst = draw_order_tmp;
+
+    for(int shift = 0; shift < 64; shift += 8)
+    {
+        if(((varying >> shift) & 0xFF) == 0)
+            continue;
+
+        int offsets[256] = {0};
+
+        for(int i = 0; i < rect_count; ++i)
+            offsets[(keys[i] >> shift) & 0xFF]++;
+
+        int sum = 0;
+        for(int b = 0; b < 256; ++b)
+        {
+            int count = offsets[b];
+            offsets[b] = sum;
+            sum += count;
+        }
+
+        for(int i = 0; i < rect_count; ++i)
+        {
+            int dst = offsets[(keys[i] >> shift) & 0xFF]++;
+            keys_dst[dst] = keys[i];
+            order_dst[dst] = order[i];
+        }
+
+        SWAP(U64*, keys, keys_dst);
+        SWAP(DrawRect**, order, order_dst);
+    }
+
+    // odd number of passes, result is in the scratch arrays
+    if(order != draw_order)
+    {
+        SWAP(U64*, draw_keys, draw_keys_tmp);
+        SWAP(DrawRect**, draw_order, draw_order_tmp);
+    }
+}
+
+// Drops instances that are off screen, empty, or entirely covered by opaque
+// rects that are drawn after them. Walks the order back to front, marking
+// tiles of a coarse grid as covered by the interior of each opaque rect.
+// An instance whose tiles are all covered can't contribute a pixel.
+// Returns the number of instances left.
+static int draw_cull()
+{
+    int res_w, res_h;
+    draw_get_resolution(&res_w, &res_h);
+
+    int tiles_x = (res_w + DRAW_CULL_TILE_SIZE-1) / DRAW_CULL_TILE_SIZE;
+    int tiles_y = (res_h + DRAW_CULL_TILE_SIZE-1) / DRAW_CULL_TILE_SIZE;
+
+    if(tiles_x <= 0 || tiles_y <= 0)
+        return 0;
+
+    if(cull_tiles_capacity < tiles_x*tiles_y)
+    {
+        cull_tiles_capacity = tiles_x*tiles_y;
+        cull_tiles = (U8*)realloc(cull_tiles, cull_tiles_capacity);
+    }
+    memset(cull_tiles, 0, tiles_x*tiles_y);
+
+    const float tile_size = DRAW_CULL_TILE_SIZE*DRAW_POS_SCALE; // in fixed point units
+    const float max_x = res_w*DRAW_POS_SCALE;
+    const float max_y = res_h*DRAW_POS_SCALE;
+
+    int remaining = 0;
+
+    for(int i = rect_count-1; i >= 0; --i)
+    {
+        DrawRect* r = draw_order[i];
+
+        // only the part inside the clip rect is ever drawn
+        float x0 = MAX(r->p0[0], r->clip_p0[0]);
+        float y0 = MAX(r->p0[1], r->clip_p0[1]);
+        float x1 = MIN(r->p1[0], r->clip_p1[0]);
+        float y1 = MIN(r->p1[1], r->clip_p1[1]);
+
+        // empty or entirely off screen
+        if(x1 <= x0 || y1 <= y0 || x1 <= 0 || y1 <= 0 || x0 >= max_x || y0 >= max_y)
+        {
+            draw_order[i] = NULL;
+            continue;
+        }
+
+        // tiles touched by the rect
+        int tx0 = (int)(MAX(x0, 0.0f) / tile_size);
+        int ty0 = (int)(MAX(y0, 0.0f) / tile_size);
+        int tx1 = (int)((MIN(x1, max_x)-1) / tile_size);
+        int ty1 = (int)((MIN(y1, max_y)-1) / tile_size);
+
+        bool hidden = true;
+        for(int ty = ty0; ty <= ty1 && hidden; ++ty)
+        {
+            for(int tx = tx0; tx <= tx1; ++tx)
+            {
+                if(!cull_tiles[ty*tiles_x + tx])
+                {
+                    hidden = false;
+                    break;
+                }
+            }
+        }
+
+        if(hidden)
+        {
+            draw_order[i] = NULL;
+            continue;
+        }
+
+        remaining++;
+
+        bool opaque = !(r->flags & (DRAW_FLAG_TEXTURED | DRAW_FLAG_IMAGE | DRAW_FLAG_LINE | DRAW_FLAG_CIRCLE)) && r->border_thickness == 0 && r->color1.a == 255 && r->color2.a == 255;
+        if(!opaque)
+            continue;
+
+        // the edges are faded over 2*softness and rounded by the corner radius,
+        // past that inset every pixel of the rect is solid
+        float inset = (r->corner_radius + 2.0f*r->edge_softness/DRAW_SOFTNESS_SCALE)*DRAW_POS_SCALE;
+
+        float ix0 = MAX(r->p0[0] + inset, x0);
+        float iy0 = MAX(r->p0[1] + inset, y0);
+        float ix1 = MIN(r->p1[0] - inset, x1);
+        float iy1 = MIN(r->p1[1] - inset, y1);
+
+        // tiles entirely inside the solid (and clipped) interior
+        int cx0 = (int)ceilf(ix0 / tile_size);
+        int cy0 = (int)ceilf(iy0 / tile_size);
+        int cx1 = (int)floorf(ix1 / tile_size) - 1;
+        int cy1 = (int)floorf(iy1 / tile_size) - 1;
+
+        cx0 = MAX(cx0, 0);
+        cy0 = MAX(cy0, 0);
+        cx1 = MIN(cx1, tiles_x-1);
+        cy1 = MIN(cy1, tiles_y-1);
+
+        for(int ty = cy0; ty <= cy1; ++ty)
+            for(int tx = cx0; tx <= cx1; ++tx)
+                cull_tiles[ty*tiles_x + tx] = 1;
+    }
+
+    return remaining;
+}
+
+// fully covers its area with no blending needed
+static inline bool draw_rect_is_opaque(DrawRect* r)
+{
+    return r->pipeline == SHADER_BASIC_RECT_SHARP && r->color1.a == 255 && r->color2.a == 255;
+}
+
+// appends r at *out with the given depth, starting a new run when the
+// pipeline or blending changes
+static inline void draw_emit(U8* dst, DrawRect** out, int* run_count, DrawRect* r, int depth, bool opaque)
+{
+    DrawRun* last = *run_count ? &draw_runs[*run_count-1] : NULL;
+    if(!last || last->pipeline != r->pipeline || last->opaque != opaque)
+    {
+        DrawRun* run = &draw_runs[(*run_count)++];
+        run->pipeline = r->pipeline;
+        run->opaque = opaque;
+        run->first = *out - (DrawRect*)dst;
+        run->count = 0;
+        last = run;
+    }
+
+    last->count++;
+
+    **out = *r;
+    (*out)->depth = (U16)depth;
+    (*out)++;
+}
+
+static inline bool draw_run_is_short(DrawRun* run)
+{
+    return run->count < DRAW_SPECIALIZE_MIN;
+}
+
+// interleaved content, like labels on buttons, alternates pipelines every
+// few instances. Neighbouring short runs with the same blending are drawn
+// as one generic run instead, their instances are already contiguous.
+// Returns the new run count
+static int draw_merge_runs(int run_count)
+{
+    int merged_count = 0;
+
+    for(int i = 0; i < run_count;)
+    {
+        DrawRun run = draw_runs[i];
+        int end = i+1;
+
+        if(draw_run_is_short(&run))
+        {
+            while(end < run_count && draw_run_is_short(&draw_runs[end]) && draw_runs[end].opaque == run.opaque)
+                end++;
+        }
+
+        // a short run on its own keeps its program, there is nothing to batch it with
+        if(end - i > 1)
+        {
+            DrawRun* last = &draw_runs[end-1];
+            run.pipeline = SHADER_BASIC_GENERIC;
+            run.count = last->first + last->count - run.first;
+            draw_stats.generic_runs++;
+        }
+
+        draw_runs[merged_count++] = run;
+        i = end;
+    }
+
+    return merged_count;
+}
+
+// gl calls since the last commit, the uploads at the start of this one included
+static void draw_take_gl_calls()
+{
+    draw_stats.gl_calls = gl_call_count;
+    gl_call_count = 0;
+}
+
+bool draw_commit()
+{
+    // before hashing, uploads change the atlas generation
+    image_update();
+    glyph_atlas_flush();
+
+    U64 frame_hash = draw_hash_frame();
+
+    if(!frame_dirty && frame_hash == last_frame_hash)
+    {
+        // nothing changed since the last drawn frame, which is still on screen
+        draw_stats.frames_skipped++;
+        draw_reset_queue();
+        draw_take_gl_calls();
+        return false;
+    }
+
+    last_frame_hash = frame_hash;
+    frame_dirty = false;
+    draw_stats.frames_drawn++;
+
+    draw_gpu_timer_poll();
+
+    bool timed = (gpu_timer.pending < DRAW_GPU_QUERIES);
+    if(timed)
+        GL_CALL(glQueryCounter(gpu_timer.queries[gpu_timer.head][0], GL_TIMESTAMP));
+
+    GL_CALL(glClearColor(clear_color.x, clear_color.y, clear_color.z, clear_color.w));
+    GL_CALL(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+
+    GL_CALL(glBindVertexArray(vao));
+
+    GL_CALL(glActiveTexture(GL_TEXTURE0));
+    GL_CALL(glBindTexture(GL_TEXTURE_2D_ARRAY, atlas.texture));
+
+    draw_build_order();
+    draw_sort_order();
+    int draw_count = draw_cull();
+
+    draw_stats.instances_queued = rect_count;
+    draw_stats.instances_culled = rect_count - draw_count;
+    draw_stats.bytes_uploaded = draw_count*sizeof(DrawRect);
+    draw_stats.draw_calls = 0;
+    draw_stats.generic_runs = 0;
+
+    if(draw_runs_capacity < draw_count)
+    {
+        draw_runs_capacity = MAX(draw_count, 2*draw_runs_capacity);
+        draw_runs = (DrawRun*)realloc(draw_runs, draw_runs_capacity*sizeof(DrawRun));
+    }
+
+    // grow to fit everything drawn this frame
+    if(draw_count > vbo_capacity)
+    {
+        int capacity = vbo_capacity;
+        while(capacity < draw_count)
+            capacity *= 2;
+
+        draw_ring_create(capacity);
+    }
+
+    int segment = ring.segment;
+    size_t base = segment*ring.segment_size;
+    size_t size = draw_count*sizeof(DrawRect);
+
+    draw_ring_wait(segment);
+
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+
+    U8* dst = NULL;
+    if(ring.persistent)
+        dst = ring.mapped + base;
+    else if(size > 0)
+        dst = (U8*)GL_CALL(glMapBufferRange(GL_ARRAY_BUFFER, base, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT));
+
+    // copy what survived culling straight into the segment. Opaque instances
+    // go first in reverse, drawn front to back with depth writes so whatever
+    // they cover is rejected before shading. The rest follow in order, depth
+    // tested against them. Depth is the position in the sorted order
+    bool depth_pass = (rect_count <= DRAW_MAX_DEPTH);
+    int run_count = 0;
+    int opaque_count = 0;
+
+    if(dst)
+    {
+        DrawRect* out = (DrawRect*)dst;
+
+        if(depth_pass)
+        {
+            for(int i = rect_count-1; i >= 0; --i)
+            {
+                DrawRect* r = draw_order[i];
+                if(!r || !draw_rect_is_opaque(r))
+                    continue;
+
+                draw_emit(dst, &out, &run_count, r, i+1, true);
+                opaque_count++;
+            }
+        }
+
+        for(int i = 0; i < rect_count; ++i)
+        {
+            DrawRect* r = draw_order[i];
+            if(!r)
+                continue;
+
+            bool opaque = draw_rect_is_opaque(r);
+            if(depth_pass && opaque)
+                continue;
+
+            draw_emit(dst, &out, &run_count, r, depth_pass ? i+1 : 0, opaque);
+        }
+
+        if(!ring.persistent)
+            GL_CALL(glUnmapBuffer(GL_ARRAY_BUFFER));
+    }
+
+    draw_stats.instances_opaque = opaque_count;
+
+    run_count = draw_merge_runs(run_count);
+
+    draw_set_attribs(base);
+    GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+
+    for(int i = 0; i < DRAW_ATTRIB_COUNT; ++i)
+        GL_CALL(glEnableVertexAttribArray(i));
+
+    int res_w, res_h;
+    draw_get_resolution(&res_w, &res_h);
+
+    // res only has to be set once per frame on every program that draws
+    U32 res_set = 0;
+    bool base_instance = GLEW_ARB_base_instance;
+    bool blend = true;
+
+    if(depth_pass && opaque_count > 0)
+    {
+        GL_CALL(glEnable(GL_DEPTH_TEST));
+        GL_CALL(glDepthFunc(GL_LESS));
+    }
+
+    for(int i = 0; i < run_count; ++i)
+    {
+        DrawRun* run = &draw_runs[i];
+        DrawPipeline* p = &draw_pipelines[run->pipeline];
+
+        GL_CALL(glUseProgram(p->program));
+
+        if(blend == run->opaque)
+        {
+            blend = !run->opaque;
+            if(blend)
+                GL_CALL(glEnable(GL_BLEND));
+            else
+                GL_CALL(glDisable(GL_BLEND));
+
+            // only the opaque pass writes depth
+            if(depth_pass)
+                GL_CALL(glDepthMask(run->opaque ? GL_TRUE : GL_FALSE));
+        }
+
+        if(!(res_set & (1u << run->pipeline)))
+        {
+            GL_CALL(glUniform2f(p->loc_res,(float)res_w, (float)res_h));
+            res_set |= (1u << run->pipeline);
+        }
+
+        if(base_instance)
+        {
+            GL_CALL(glDrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, 4, run->count, run->first));
+        }
+        else
+        {
+            // no base instance, point the attributes at the run instead
+            GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, vbo));
+            draw_set_attribs(base + run->first*sizeof(DrawRect));
+            GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, 0));
+            GL_CALL(glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, run->count));
+        }
+
+        draw_stats.draw_calls++;
+    }
+
+    if(!blend)
+        GL_CALL(glEnable(GL_BLEND));
+
+    if(depth_pass && opaque_count > 0)
+    {
+        GL_CALL(glDisable(GL_DEPTH_TEST));
+        GL_CALL(glDepthMask(GL_TRUE)); // the clear respects the mask
+    }
+
+    draw_reset_queue();
+
+    if(timed)
+    {
+        GL_CALL(glQueryCounter(gpu_timer.queries[gpu_timer.head][1], GL_TIMESTAMP));
+        gpu_timer.head = (gpu_timer.head+1) % DRAW_GPU_QUERIES;
+        gpu_timer.pending++;
+    }
+
+    ring.fences[segment] = GL_CALL(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+    ring.segment = (segment+1) % DRAW_RING_SEGMENTS;
+
+    for(int i = 0; i < DRAW_ATTRIB_COUNT; ++i)
+        GL_CALL(glDisableVertexAttribArray(i));
+
+    GL_CALL(glBindVertexArray(0));
+    GL_CALL(glUseProgram(0));
+
+    draw_take_gl_calls();
+    return true;
 }
@@ -0,0 +1,327 @@
+//
+// Font Packs
+//
+// The baked ascii font as a single binary file: a header, the FontChar
+// table, the kerning pairs of the baked chars and the raw rgba pixels of
+// the font image. load_font() maps it and uploads the pixels straight from
+// the mapping, so starting up neither decodes a png nor parses text.
+// tools/font_pack.c builds it from the png and csv files the font generator
+// writes, those stay the fallback when there's no (valid) pack. The pack
+// is in the byte order and struct layout of the machine that wrote it, a
+// mismatch is caught by the header.
+//
+// API:
+//
+// bool font_pack_open(FontPack* pack, const char* path);
+// void font_pack_close(FontPack* pack);
+// bool font_pack_write(const char* path, FontChar* chars, FontKern* kerns, int kern_count, int w, int h, U8* rgba);
+// bool font_layout_parse(const char* path, int image_h, FontChar* chars); // FONT_PACK_CHARS chars
+// int  font_kerning_parse(const char* path, FontKern** kerns); // pair count, *kerns is malloc'd
+// bool font_source_load(FontSource* source, const char* pack_path, const char* image_path, const char* layout_path, const char* kerning_path);
+// void font_source_free(FontSource* source);
+//
+
+#define FONT_PACK_MAGIC   "CGFP"
+#define FONT_PACK_VERSION 1
+#define FONT_PACK_CHARS   256
+
+typedef struct
+{
+    float l,b,r,t;
+} CharBox;
+
+typedef struct
+{
+    float advance;
+    CharBox plane_box;
+    CharBox pixel_box;
+    CharBox tex_coords; // px of the font image until load_font() places them in the atlas
+    float w,h;
+    U32 kern_id; // baked chars use their code point, runtime glyphs FONT_KERN_TTF | glyph
+} FontChar;
+
+typedef struct
+{
+    U32 left, right; // code points
+    float value;     // em
+} FontKern;
+
+typedef struct
+{
+    char magic[4];
+    U32 version;
+    U32 char_size; // sizeof(FontChar) when written
+    U32 width;
+    U32 height;
+    U32 kern_count;
+
+    // from the start of the file
+    U32 chars_offset;
+    U32 kerns_offset;
+    U32 pixels_offset;
+} FontPackHeader;
+
+typedef struct
+{
+    FileMapping file;
+    FontPackHeader* header;
+    FontChar* chars;
+    FontKern* kerns;
+    U8* pixels;
+} FontPack;
+
+// the baked font in memory and ready for upload, needs no GL so it can be
+// loaded on any thread
+typedef struct
+{
+    bool loaded;
+    bool packed;
+    FontPack pack; // pixels and kerns point into it if packed
+
+    int w, h;
+    U8* pixels; // rgba
+    FontChar chars[FONT_PACK_CHARS];
+    FontKern* kerns;
+    int kern_count;
+} FontSource;
+
+void font_pack_close(FontPack* pack)
+{
+    file_unmap(&pack->file);
+    memset(pack, 0, sizeof(FontPack));
+}
+
+// false if there's no pack at path or it was written for a different build
+bool font_pack_open(FontPack* pack, const char* path)
+{
+    memset(pack, 0, sizeof(FontPack));
+
+    if(!file_map(path, &pack->file))
+        return false;
+
+    U8* data = pack->file.data;
+    size_t size = pack->file.size;
+    FontPackHeader* header = (FontPackHeader*)data;
+
+    bool valid = size >= sizeof(FontPackHeader) &&
+                 memcmp(header->magic, FONT_PACK_MAGIC, 4) == 0 &&
+                 header->version == FONT_PACK_VERSION &&
+                 header->char_size == sizeof(FontChar);
+
+    valid = valid &&
+            header->chars_offset + (size_t)FONT_PACK_CHARS*sizeof(FontChar) <= size &&
+            header->kerns_offset + (size_t)header->kern_count*sizeof(FontKern) <= size &&
+            header->pixels_offset + (size_t)header->width*header->height*4 <= size;
+
+    if(!valid)
+    {
+        logw("Font pack %s doesn't match this build, rebuild it with tools/font_pack.c", path);
+        font_pack_close(pack);
+        return false;
+    }
+
+    pack->header = header;
+    pack->chars = (FontChar*)(data + header->chars_offset);
+    pack->kerns = (FontKern*)(data + header->kerns_offset);
+    pack->pixels = data + header->pixels_offset;
+
+    return true;
+}
+
+bool font_pack_write(const char* path, FontChar* chars, FontKern* kerns, int kern_count, int w, int h, U8* rgba)
+{
+    FontPackHeader header = {0};
+    memcpy(header.magic, FONT_PACK_MAGIC, 4);
+    header.version = FONT_PACK_VERSION;
+    header.char_size = sizeof(FontChar);
+    header.width = w;
+    header.height = h;
+    header.kern_count = kern_count;
+
+    // pixels start at a 16 byte boundary for the upload
+    header.chars_offset = sizeof(FontPackHeader);
+    header.kerns_offset = header.chars_offset + FONT_PACK_CHARS*sizeof(FontChar);
+    header.pixels_offset = (header.kerns_offset + kern_count*sizeof(FontKern) + 15) & ~15u;
+
+    FILE* fp = fopen(path, "wb");
+    if(!fp)
+    {
+        loge("Failed to write font pack: %s", path);
+        return false;
+    }
+
+    static const U8 zeros[16] = {0};
+    size_t padding = header.pixels_offset - (header.kerns_offset + kern_count*sizeof(FontKern));
+
+    bool written = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+                   fwrite(chars, sizeof(FontChar), FONT_PACK_CHARS, fp) == FONT_PACK_CHARS &&
+                   fwrite(kerns, sizeof(FontKern), kern_count, fp) == (size_t)kern_count &&
+                   fwrite(zeros, 1, padding, fp) == padding &&
+                   fwrite(rgba, 4, (size_t)w*h, fp) == (size_t)w*h;
+
+    fclose(fp);
+
+    if(!written)
+        loge("Failed to write font pack: %s", path);
+
+    return written;
+}
+
+// csv of the font generator, one char per line:
+// code point, advance, plane box (l,b,r,t), pixel box in the image (l,b,r,t)
+bool font_layout_parse(const char* path, int image_h, FontChar* chars)
+{
+    FILE* fp = fopen(path,"r");
+
+    if(!fp)
+    {
+        logw("Failed to load font layout file");
+        return false;
+    }
+
+    memset(chars, 0, FONT_PACK_CHARS*sizeof(FontChar));
+
+    char line[256] = {0};
+
+    while(fgets(line,255,fp) != NULL)
+    {
+        int char_index = 0;
+        float advance, pl_l, pl_b, pl_r, pl_t,  px_l, px_b, px_r, px_t;
+
+        int n = sscanf(line,"%d,%f,%f,%f,%f,%f,%f,%f,%f,%f ",&char_index,&advance,&pl_l, &pl_b, &pl_r, &pl_t, &px_l, &px_b, &px_r, &px_t);
+
+        if(n != 10 || char_index < 0 || char_index >= FONT_PACK_CHARS)
+            continue;
+
+        FontChar* fc = &chars[char_index];
+
+        fc->advance = advance;
+        fc->kern_id = char_index;
+
+        fc->plane_box.l = pl_l;
+        fc->plane_box.b = pl_b;
+        fc->plane_box.r = pl_r;
+        fc->plane_box.t = pl_t;
+
+        fc->pixel_box.l = px_l;
+        fc->pixel_box.b = px_b;
+        fc->pixel_box.r = px_r;
+        fc->pixel_box.t = px_t;
+
+        // pixel boxes have their origin at the bottom of the font image
+        fc->tex_coords.l = px_l;
+        fc->tex_coords.b = image_h - px_b;
+        fc->tex_coords.r = px_r;
+        fc->tex_coords.t = image_h - px_t;
+
+        fc->w = px_r - px_l;
+        fc->h = px_b - px_t;
+    }
+
+    fclose(fp);
+    return true;
+}
+
+// optional csv of kerning pairs: left, right, adjustment in em
+int font_kerning_parse(const char* path, FontKern** kerns)
+{
+    *kerns = NULL;
+
+    FILE* fp = fopen(path, "r");
+    if(!fp)
+        return 0;
+
+    int count = 0;
+    int capacity = 0;
+
+    char line[256] = {0};
+
+    while(fgets(line,255,fp) != NULL)
+    {
+        int left, right;
+        float value;
+
+        if(sscanf(line,"%d,%d,%f ",&left,&right,&value) != 3)
+            continue;
+
+        if(left <= 0 || left >= FONT_PACK_CHARS || right <= 0 || right >= FONT_PACK_CHARS)
+            continue;
+
+        if(count == capacity)
+        {
+            capacity = MAX(64, 2*capacity);
+            *kerns = (FontKern*)realloc(*kerns, capacity*sizeof(FontKern));
+        }
+
+        (*kerns)[count].left = left;
+        (*kerns)[count].right = right;
+        (*kerns)[count].value = value;
+        count++;
+    }
+
+    fclose(fp);
+    return count;
+}
+
+void font_source_free(FontSource* source)
+{
+    if(source->packed)
+    {
+        font_pack_close(&source->pack);
+    }
+    else
+    {
+        stbi_image_free(source->pixels);
+        free(source->kerns);
+    }
+
+    memset(source, 0, sizeof(FontSource));
+}
+
+// from the pack if there's a valid one at pack_path (can be NULL), decoded
+// from the png and csv files otherwise
+bool font_source_load(FontSource* source, const char* pack_path, const char* image_path, const char* layout_path, const char* kerning_path)
+{
+    memset(source, 0, sizeof(FontSource));
+
+    if(pack_path && font_pack_open(&source->pack, pack_path))
+    {
+        FontPack* pack = &source->pack;
+
+        source->packed = true;
+        source->w = pack->header->width;
+        source->h = pack->header->height;
+        source->pixels = pack->pixels;
+        source->kerns = pack->kerns;
+        source->kern_count = pack->header->kern_count;
+        memcpy(source->chars, pack->chars, sizeof(source->chars));
+
+        // fault the pixels in here rather than during the upload
+        volatile U8 sink = 0;
+        size_t bytes = (size_t)source->w*source->h*4;
+        for(size_t i = 0; i < bytes; i += 4096)
+            sink += source->pixels[i];
+
+        source->loaded = true;
+        return true;
+    }
+
+    int n;
+    source->pixels = stbi_load(image_path, &source->w, &source->h, &n, 4);
+
+    if(!source->pixels)
+    {
+        loge("Failed to load image: %s", image_path);
+        return false;
+    }
+
+    if(!font_layout_parse(layout_path, source->h, source->chars))
+    {
+        font_source_free(source);
+        return false;
+    }
+
+    source->kern_count = font_kerning_parse(kerning_path, &source->kerns);
+    source->loaded = true;
+    return true;
+}
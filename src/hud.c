@@ -0,0 +1,185 @@
+//
+// Performance HUD
+//
+// On screen counters drawn with draw.c on top of everything else: frame and
+// phase timings, gpu time, renderer stats, process cpu usage and a graph of
+// the last HUD_GRAPH_FRAMES frame times. The counters are kept while the HUD
+// is disabled too, so hud_get_counters() works without it, only hud_draw()
+// returns right away.
+//
+// API:
+//
+// void hud_set_enabled(bool enabled);
+// bool hud_is_enabled();
+// void hud_phase_begin(HudPhase phase);
+// void hud_phase_end(HudPhase phase);
+// void hud_frame_end(Timer* timer); // once per frame, after draw_commit()
+// void hud_draw(); // queues the hud, call last before draw_commit()
+// HudCounters hud_get_counters();
+//
+
+#define HUD_GRAPH_FRAMES 240
+#define HUD_CPU_INTERVAL 0.5 // seconds between cpu usage samples
+
+typedef enum
+{
+    HUD_PHASE_BUILD,  // recording draw calls
+    HUD_PHASE_LAYOUT, // ui layout
+    HUD_PHASE_COMMIT, // draw_commit()
+
+    HUD_PHASE_COUNT
+} HudPhase;
+
+typedef struct
+{
+    DrawStats draw;
+    double phase_ms[HUD_PHASE_COUNT]; // cpu, last frame
+    double frame_ms;
+    double gpu_ms;
+    double gpu_ms_avg;
+    double cpu_usage; // process cpu time over wall time, 1.0 is one core
+} HudCounters;
+
+static struct
+{
+    bool enabled;
+
+    HudCounters counters;
+    double phase_start[HUD_PHASE_COUNT];
+
+    double frame_last;
+    float graph[HUD_GRAPH_FRAMES]; // frame ms
+    int graph_head;
+    int graph_count;
+
+    double cpu_wall_last;
+    double cpu_time_last;
+} hud = {0};
+
+// user + system time of the whole process, in seconds
+static double hud_get_process_time()
+{
+#if PLATFORM == PLATFORM_WINDOWS
+    FILETIME creation, exit, kernel, user;
+    if(!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+        return 0.0;
+
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+
+    return (k.QuadPart + u.QuadPart) / 10000000.0; // 100ns units
+#else
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0.0;
+
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+#endif
+}
+
+void hud_set_enabled(bool enabled)
+{
+    hud.enabled = enabled;
+}
+
+bool hud_is_enabled()
+{
+    return hud.enabled;
+}
+
+void hud_phase_begin(HudPhase phase)
+{
+    hud.phase_start[phase] = timer_get_time();
+}
+
+void hud_phase_end(HudPhase phase)
+{
+    hud.counters.phase_ms[phase] = 1000.0*(timer_get_time() - hud.phase_start[phase]);
+}
+
+void hud_frame_end(Timer* timer)
+{
+    double now = timer_get_time();
+
+    hud.counters.frame_ms = 1000.0*(now - hud.frame_last);
+    hud.frame_last = now;
+
+    hud.counters.draw = draw_get_stats();
+    hud.counters.gpu_ms = timer->gpu_ms;
+    hud.counters.gpu_ms_avg = timer->gpu_ms_avg;
+
+    hud.graph[hud.graph_head] = hud.counters.frame_ms;
+    hud.graph_head = (hud.graph_head+1) % HUD_GRAPH_FRAMES;
+    if(hud.graph_count < HUD_GRAPH_FRAMES)
+        hud.graph_count++;
+
+    double wall = now - hud.cpu_wall_last;
+    if(wall >= HUD_CPU_INTERVAL)
+    {
+        double cpu_time = hud_get_process_time();
+
+        hud.counters.cpu_usage = (cpu_time - hud.cpu_time_last) / wall;
+        hud.cpu_time_last = cpu_time;
+        hud.cpu_wall_last = now;
+    }
+}
+
+HudCounters hud_get_counters()
+{
+    return hud.counters;
+}
+
+void hud_draw()
+{
+    if(!hud.enabled)
+        return;
+
+    HudCounters* c = &hud.counters;
+
+    const float scale = 0.22;
+    const float line_h = 64.0*scale;
+    const float pad = 6.0;
+    const float graph_h = 50.0;
+    const float w = HUD_GRAPH_FRAMES + 2*pad;
+    const float h = 6*line_h + graph_h + 3*pad;
+    const float x = view_width - w - pad;
+    const float y = pad;
+
+    U8 layer = draw_get_layer();
+    draw_set_layer(DRAW_LAYER_DEBUG);
+
+    draw_rect_full(x, y, w, h, colora(0.0,0.0,0.0,0.75), colora(0.0,0.0,0.0,0.75), true, 0.0, 4.0, 1.0);
+
+    float ty = y + pad;
+    float tx = x + pad;
+
+    draw_string(tx, ty, scale, WHITE, "frame %6.2f ms  cpu %3.0f%%", c->frame_ms, 100.0*c->cpu_usage); ty += line_h;
+    draw_string(tx, ty, scale, WHITE, "build %.2f  layout %.2f  commit %.2f", c->phase_ms[HUD_PHASE_BUILD], c->phase_ms[HUD_PHASE_LAYOUT], c->phase_ms[HUD_PHASE_COMMIT]); ty += line_h;
+    draw_string(tx, ty, scale, WHITE, "gpu %.3f ms (avg %.3f)", c->gpu_ms, c->gpu_ms_avg); ty += line_h;
+    draw_string(tx, ty, scale, WHITE, "instances %d  culled %d  opaque %d", c->draw.instances_queued, c->draw.instances_culled, c->draw.instances_opaque); ty += line_h;
+    draw_string(tx, ty, scale, WHITE, "upload %.1f KB  runs %d (%d generic)", c->draw.bytes_uploaded/1024.0, c->draw.draw_calls, c->draw.generic_runs); ty += line_h;
+    draw_string(tx, ty, scale, WHITE, "drawn %llu  skipped %llu  gl %d", (unsigned long long)c->draw.frames_drawn, (unsigned long long)c->draw.frames_skipped, c->draw.gl_calls); ty += line_h;
+
+    // frame time graph, oldest on the left. full height is 2 frames at TARGET_FPS
+    const float graph_max_ms = 2000.0/TARGET_FPS;
+    float gy = ty + pad + graph_h;
+
+    draw_rect_full(tx, gy - graph_h/2.0, HUD_GRAPH_FRAMES, 1.0, colora(1.0,1.0,1.0,0.3), colora(1.0,1.0,1.0,0.3), true, 0.0, 0.0, 0.0);
+
+    for(int i = 0; i < hud.graph_count; ++i)
+    {
+        int index = (hud.graph_head - hud.graph_count + i + HUD_GRAPH_FRAMES) % HUD_GRAPH_FRAMES;
+        float ms = hud.graph[index];
+
+        float bar_h = graph_h*MIN(ms/graph_max_ms, 1.0);
+        Vec4f bar_color = (ms <= 1000.0/TARGET_FPS) ? GREEN : (ms <= graph_max_ms ? YELLOW : RED);
+
+        draw_rect_full(tx + HUD_GRAPH_FRAMES - hud.graph_count + i, gy - bar_h, 1.0, bar_h, bar_color, bar_color, true, 0.0, 0.0, 0.0);
+    }
+
+    draw_set_layer(layer);
+}
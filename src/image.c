@@ -0,0 +1,618 @@
+//
+// Images
+//
+// Images loaded by path into the texture atlas without blocking the caller.
+// A small pool of worker threads decodes them (scaled down to fit an atlas
+// page, or max_size), the GL thread then uploads a limited number of bytes
+// per frame through pixel buffer objects, so large images are spread over
+// several frames. The cpu copy is freed once it's uploaded, and decoded
+// images that wait for their upload are kept under IMAGE_DECODE_BUDGET.
+// Images are shared by path and reference counted. Once the last reference
+// is released an image stays cached in the atlas, acquiring it again is
+// instant. Cached images are evicted least recently released first when an
+// upload needs the space or there are more than IMAGE_CACHE_MAX of them,
+// but never before the commit of the frame they were released in, so a
+// region drawn in that frame isn't handed to another image under it.
+//
+//     ImageHandle h = image_acquire("shot.png", 256);
+//     ...
+//     AtlasRegion* r = image_get(h); // NULL until it's uploaded
+//     if(r) draw_image(x, y, r->w, r->h, r, WHITE);
+//
+// API:
+//
+// void image_init();
+// void image_deinit();
+// ImageHandle image_acquire(const char* path, int max_size); // 0 if every slot is taken, max_size 0 for the largest that fits
+// void image_release(ImageHandle handle);
+// AtlasRegion* image_get(ImageHandle handle); // NULL if it isn't ready
+// ImageState image_get_state(ImageHandle handle);
+// void image_update(); // uploads, called by draw_commit() on the GL thread
+//
+
+#define IMAGE_MAX_COUNT     256
+#define IMAGE_WORKER_COUNT  2
+#define IMAGE_PBO_COUNT     3
+#define IMAGE_DECODE_BUDGET (64*1024*1024) // bytes of decoded pixels waiting for upload
+#define IMAGE_UPLOAD_BUDGET (4*1024*1024)  // bytes uploaded per frame, size of each pbo
+#define IMAGE_CACHE_MAX     32 // released images kept in the atlas
+#define IMAGE_MAX_SIZE      (ATLAS_PAGE_SIZE - 2*ATLAS_PADDING)
+
+typedef U32 ImageHandle; // generation << 16 | slot+1, 0 is no image
+
+typedef enum
+{
+    IMAGE_STATE_NONE,      // free slot or stale handle
+    IMAGE_STATE_QUEUED,    // waiting for a worker
+    IMAGE_STATE_DECODING,
+    IMAGE_STATE_DECODED,   // waiting for the GL thread
+    IMAGE_STATE_UPLOADING, // part of the rows are in the atlas
+    IMAGE_STATE_READY,
+    IMAGE_STATE_FAILED,
+} ImageState;
+
+typedef struct
+{
+    char path[256];
+    int max_size;
+
+    U16 generation;
+    int refs;
+    bool released; // no refs left, cleaned up by whoever owns it in its state
+    U32 release_frame;  // images.frame when it was released
+    U32 release_serial; // eviction order of cached images
+    ImageState state;
+
+    int w, h;
+    size_t bytes; // of the decoded pixels, counted against the budget
+    U8* pixels;   // only touched by the GL thread once decoded
+    int uploaded_rows;
+    AtlasRegion region;
+} ImageSlot;
+
+static struct
+{
+    bool initialized;
+    ImageSlot slots[IMAGE_MAX_COUNT];
+
+    // slot indices in load order
+    int queue[IMAGE_MAX_COUNT];
+    int queue_head;
+    int queue_count;
+
+    size_t decoded_bytes;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t wake; // work was queued, budget freed up or quit
+    pthread_t workers[IMAGE_WORKER_COUNT];
+    int worker_count;
+    bool quit;
+
+    GLuint pbos[IMAGE_PBO_COUNT];
+    int pbo;
+
+    U32 frame; // image_update() calls
+    U32 release_serial;
+} images = {0};
+
+static ImageSlot* image_slot(ImageHandle handle)
+{
+    int index = (int)(handle & 0xFFFF) - 1;
+
+    if(index < 0 || index >= IMAGE_MAX_COUNT)
+        return NULL;
+
+    ImageSlot* slot = &images.slots[index];
+    if(slot->generation != (handle >> 16) || slot->state == IMAGE_STATE_NONE)
+        return NULL;
+
+    return slot;
+}
+
+static void image_fit(int w, int h, int max_size, int* fw, int* fh)
+{
+    *fw = w;
+    *fh = h;
+
+    if(w > max_size || h > max_size)
+    {
+        float scale = max_size / (float)MAX(w, h);
+        *fw = MAX(1, (int)(w*scale));
+        *fh = MAX(1, (int)(h*scale));
+    }
+}
+
+// box filter, every destination pixel averages the source pixels it covers
+static void image_downscale(U8* src, int sw, int sh, U8* dst, int dw, int dh)
+{
+    for(int y = 0; y < dh; ++y)
+    {
+        int y0 = y*sh/dh;
+        int y1 = MAX(y0+1, (y+1)*sh/dh);
+
+        for(int x = 0; x < dw; ++x)
+        {
+            int x0 = x*sw/dw;
+            int x1 = MAX(x0+1, (x+1)*sw/dw);
+
+            U32 sum[4] = {0};
+            for(int sy = y0; sy < y1; ++sy)
+            {
+                U8* p = src + ((size_t)sy*sw + x0)*4;
+                for(int sx = x0; sx < x1; ++sx, p += 4)
+                {
+                    sum[0] += p[0];
+                    sum[1] += p[1];
+                    sum[2] += p[2];
+                    sum[3] += p[3];
+                }
+            }
+
+            U32 count = (U32)((y1-y0)*(x1-x0));
+            U8* d = dst + ((size_t)y*dw + x)*4;
+            for(int c = 0; c < 4; ++c)
+                d[c] = (U8)((sum[c] + count/2)/count);
+        }
+    }
+}
+
+// rgba pixels of at most max_size, NULL on failure
+static U8* image_decode(const char* path, int max_size, int* w, int* h)
+{
+    int sw, sh, n;
+    U8* data = stbi_load(path, &sw, &sh, &n, 4);
+
+    if(!data)
+    {
+        loge("Failed to load image: %s (%s)", path, stbi_failure_reason());
+        return NULL;
+    }
+
+    image_fit(sw, sh, max_size, w, h);
+
+    if(*w == sw && *h == sh)
+        return data;
+
+    // asked for explicitly otherwise
+    if(max_size == IMAGE_MAX_SIZE)
+        logw("Image %s is scaled down from %d x %d to %d x %d to fit an atlas page", path, sw, sh, *w, *h);
+
+    U8* scaled = (U8*)malloc((size_t)*w * *h * 4);
+    image_downscale(data, sw, sh, scaled, *w, *h);
+    stbi_image_free(data);
+
+    return scaled;
+}
+
+static void* image_worker(void* arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&images.mutex);
+
+    while(!images.quit)
+    {
+        if(images.queue_count == 0)
+        {
+            pthread_cond_wait(&images.wake, &images.mutex);
+            continue;
+        }
+
+        int index = images.queue[images.queue_head];
+        images.queue_head = (images.queue_head+1) % IMAGE_MAX_COUNT;
+        images.queue_count--;
+
+        ImageSlot* slot = &images.slots[index];
+
+        if(slot->released)
+        {
+            slot->state = IMAGE_STATE_NONE;
+            continue;
+        }
+
+        char path[256];
+        memcpy(path, slot->path, sizeof(path));
+        int max_size = slot->max_size;
+
+        // the size is known from the header, wait until it fits the budget.
+        // A single image larger than the whole budget still goes through
+        int iw, ih, n;
+        pthread_mutex_unlock(&images.mutex);
+        bool known = stbi_info(path, &iw, &ih, &n);
+        pthread_mutex_lock(&images.mutex);
+
+        size_t bytes = 0;
+        if(known)
+        {
+            int fw, fh;
+            image_fit(iw, ih, max_size, &fw, &fh);
+            bytes = (size_t)fw*fh*4;
+
+            while(!images.quit && images.decoded_bytes > 0 && images.decoded_bytes + bytes > IMAGE_DECODE_BUDGET)
+                pthread_cond_wait(&images.wake, &images.mutex);
+        }
+
+        images.decoded_bytes += bytes;
+        slot->state = IMAGE_STATE_DECODING;
+        pthread_mutex_unlock(&images.mutex);
+
+        int w = 0, h = 0;
+        U8* pixels = known ? image_decode(path, max_size, &w, &h) : NULL;
+        if(!known)
+            loge("Failed to load image: %s (%s)", path, stbi_failure_reason());
+
+        pthread_mutex_lock(&images.mutex);
+
+        images.decoded_bytes -= bytes;
+
+        if(slot->released)
+        {
+            stbi_image_free(pixels);
+            slot->state = IMAGE_STATE_NONE;
+        }
+        else if(!pixels)
+        {
+            slot->state = IMAGE_STATE_FAILED;
+        }
+        else
+        {
+            slot->w = w;
+            slot->h = h;
+            slot->bytes = (size_t)w*h*4;
+            slot->pixels = pixels;
+            slot->uploaded_rows = 0;
+            slot->state = IMAGE_STATE_DECODED;
+            images.decoded_bytes += slot->bytes;
+        }
+
+        // another worker may be waiting on the budget
+        pthread_cond_broadcast(&images.wake);
+    }
+
+    pthread_mutex_unlock(&images.mutex);
+    return NULL;
+}
+
+void image_init()
+{
+    if(images.initialized)
+        return;
+
+    memset(&images, 0, sizeof(images));
+    pthread_mutex_init(&images.mutex, NULL);
+    pthread_cond_init(&images.wake, NULL);
+
+    glGenBuffers(IMAGE_PBO_COUNT, images.pbos);
+
+    for(int i = 0; i < IMAGE_WORKER_COUNT; ++i)
+    {
+        if(pthread_create(&images.workers[images.worker_count], NULL, image_worker, NULL) == 0)
+            images.worker_count++;
+    }
+
+    if(images.worker_count == 0)
+        logw("No image workers could be started, images won't load");
+
+    images.initialized = true;
+}
+
+void image_deinit()
+{
+    if(!images.initialized)
+        return;
+
+    pthread_mutex_lock(&images.mutex);
+    images.quit = true;
+    pthread_cond_broadcast(&images.wake);
+    pthread_mutex_unlock(&images.mutex);
+
+    for(int i = 0; i < images.worker_count; ++i)
+        pthread_join(images.workers[i], NULL);
+
+    for(int i = 0; i < IMAGE_MAX_COUNT; ++i)
+        stbi_image_free(images.slots[i].pixels);
+
+    glDeleteBuffers(IMAGE_PBO_COUNT, images.pbos);
+
+    pthread_cond_destroy(&images.wake);
+    pthread_mutex_destroy(&images.mutex);
+
+    images.initialized = false;
+}
+
+ImageHandle image_acquire(const char* path, int max_size)
+{
+    if(!images.initialized || strlen(path) >= sizeof(images.slots[0].path))
+        return 0;
+
+    max_size = (max_size <= 0) ? IMAGE_MAX_SIZE : MIN(max_size, IMAGE_MAX_SIZE);
+
+    ImageHandle handle = 0;
+    int free_index = -1;
+
+    pthread_mutex_lock(&images.mutex);
+
+    for(int i = 0; i < IMAGE_MAX_COUNT && !handle; ++i)
+    {
+        ImageSlot* slot = &images.slots[i];
+
+        if(slot->state == IMAGE_STATE_NONE)
+        {
+            if(free_index < 0) free_index = i;
+            continue;
+        }
+
+        if(slot->max_size != max_size || strcmp(slot->path, path) != 0)
+            continue;
+
+        // released but not cleaned up yet is taken back as it is
+        if(slot->released)
+        {
+            slot->released = false;
+            slot->refs = 0;
+        }
+
+        slot->refs++;
+        handle = ((U32)slot->generation << 16) | (U32)(i+1);
+    }
+
+    if(!handle && free_index >= 0)
+    {
+        ImageSlot* slot = &images.slots[free_index];
+        U16 generation = slot->generation + 1;
+
+        memset(slot, 0, sizeof(ImageSlot));
+        strcpy(slot->path, path);
+        slot->max_size = max_size;
+        slot->generation = generation;
+        slot->refs = 1;
+        slot->state = IMAGE_STATE_QUEUED;
+
+        images.queue[(images.queue_head + images.queue_count) % IMAGE_MAX_COUNT] = free_index;
+        images.queue_count++;
+        pthread_cond_signal(&images.wake);
+
+        handle = ((U32)generation << 16) | (U32)(free_index+1);
+    }
+
+    pthread_mutex_unlock(&images.mutex);
+
+    if(!handle)
+        logw("No free image slot for %s", path);
+
+    return handle;
+}
+
+void image_release(ImageHandle handle)
+{
+    pthread_mutex_lock(&images.mutex);
+
+    ImageSlot* slot = image_slot(handle);
+    if(slot && !slot->released && --slot->refs <= 0)
+    {
+        slot->released = true;
+        slot->release_frame = images.frame;
+        slot->release_serial = ++images.release_serial;
+    }
+
+    pthread_mutex_unlock(&images.mutex);
+}
+
+ImageState image_get_state(ImageHandle handle)
+{
+    pthread_mutex_lock(&images.mutex);
+
+    ImageSlot* slot = image_slot(handle);
+    ImageState state = (slot && !slot->released) ? slot->state : IMAGE_STATE_NONE;
+
+    pthread_mutex_unlock(&images.mutex);
+
+    return state;
+}
+
+// the region stays valid until the commit of the frame the handle is
+// released in
+AtlasRegion* image_get(ImageHandle handle)
+{
+    pthread_mutex_lock(&images.mutex);
+
+    ImageSlot* slot = image_slot(handle);
+    AtlasRegion* region = (slot && !slot->released && slot->state == IMAGE_STATE_READY) ? &slot->region : NULL;
+
+    pthread_mutex_unlock(&images.mutex);
+
+    return region;
+}
+
+static int image_cached_count()
+{
+    int count = 0;
+
+    for(int i = 0; i < IMAGE_MAX_COUNT; ++i)
+        count += (images.slots[i].released && images.slots[i].state == IMAGE_STATE_READY);
+
+    return count;
+}
+
+// gives the region of the least recently released cached image back to
+// the atlas. false if there's none that can go yet. Call with the mutex held
+static bool image_evict()
+{
+    ImageSlot* oldest = NULL;
+
+    for(int i = 0; i < IMAGE_MAX_COUNT; ++i)
+    {
+        ImageSlot* slot = &images.slots[i];
+
+        // released this frame, it may still be drawn by this commit
+        if(!slot->released || slot->state != IMAGE_STATE_READY || slot->release_frame == images.frame)
+            continue;
+
+        if(!oldest || slot->release_serial < oldest->release_serial)
+            oldest = slot;
+    }
+
+    if(!oldest)
+        return false;
+
+    atlas_free(&oldest->region);
+    oldest->state = IMAGE_STATE_NONE;
+    return true;
+}
+
+// a band of rows of the slot, copied into the pbo at offset
+typedef struct
+{
+    ImageSlot* slot;
+    int row;
+    int rows;
+    size_t offset;
+} ImageUpload;
+
+void image_update()
+{
+    if(!images.initialized)
+        return;
+
+    ImageUpload uploads[IMAGE_MAX_COUNT];
+    int upload_count = 0;
+    size_t budget = IMAGE_UPLOAD_BUDGET;
+    bool freed = false;
+
+    pthread_mutex_lock(&images.mutex);
+
+    for(int i = 0; i < IMAGE_MAX_COUNT; ++i)
+    {
+        ImageSlot* slot = &images.slots[i];
+        ImageState state = slot->state;
+
+        if(state < IMAGE_STATE_DECODED)
+            continue;
+
+        // once decoded, released slots are cleaned up here. Ready ones stay
+        // cached, the regions of those still uploading were never drawn
+        if(slot->released)
+        {
+            if(state == IMAGE_STATE_READY)
+                continue;
+
+            if(slot->pixels)
+                images.decoded_bytes -= slot->bytes;
+            if(state == IMAGE_STATE_UPLOADING)
+                atlas_free(&slot->region);
+
+            stbi_image_free(slot->pixels);
+            slot->pixels = NULL;
+            slot->state = IMAGE_STATE_NONE;
+            freed = true;
+            continue;
+        }
+
+        if(state != IMAGE_STATE_DECODED && state != IMAGE_STATE_UPLOADING)
+            continue;
+
+        if(state == IMAGE_STATE_DECODED)
+        {
+            if(budget < (size_t)slot->w*4)
+                continue;
+
+            bool allocated = atlas_try_alloc(slot->w, slot->h, &slot->region);
+            while(!allocated && image_evict())
+                allocated = atlas_try_alloc(slot->w, slot->h, &slot->region);
+
+            // images released this frame can be evicted by the next one
+            if(!allocated && image_cached_count() > 0)
+                continue;
+
+            if(!allocated)
+            {
+                loge("No atlas space left for image %s (%d x %d)", slot->path, slot->w, slot->h);
+
+                stbi_image_free(slot->pixels);
+                slot->pixels = NULL;
+                images.decoded_bytes -= slot->bytes;
+                slot->state = IMAGE_STATE_FAILED;
+                freed = true;
+                continue;
+            }
+
+            slot->state = IMAGE_STATE_UPLOADING;
+        }
+
+        size_t pitch = (size_t)slot->w*4;
+        int rows = MIN(slot->h - slot->uploaded_rows, (int)(budget/pitch));
+        if(rows <= 0)
+            continue;
+
+        ImageUpload* upload = &uploads[upload_count++];
+        upload->slot = slot;
+        upload->row = slot->uploaded_rows;
+        upload->rows = rows;
+        upload->offset = IMAGE_UPLOAD_BUDGET - budget;
+
+        budget -= rows*pitch;
+    }
+
+    int cached_count = image_cached_count();
+    while(cached_count > IMAGE_CACHE_MAX && image_evict())
+        cached_count--;
+
+    // releases from here on are drawn by the next commit at the earliest
+    images.frame++;
+
+    pthread_mutex_unlock(&images.mutex);
+
+    if(upload_count > 0)
+    {
+        // orphaned each frame so the copy never waits on the previous upload
+        GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, images.pbos[images.pbo]));
+        GL_CALL(glBufferData(GL_PIXEL_UNPACK_BUFFER, IMAGE_UPLOAD_BUDGET, NULL, GL_STREAM_DRAW));
+
+        U8* mapped = (U8*)GL_CALL(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, IMAGE_UPLOAD_BUDGET, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+
+        if(mapped)
+        {
+            // pixels of uploading slots are only touched on this thread
+            for(int i = 0; i < upload_count; ++i)
+            {
+                ImageUpload* upload = &uploads[i];
+                size_t pitch = (size_t)upload->slot->w*4;
+                memcpy(mapped + upload->offset, upload->slot->pixels + upload->row*pitch, upload->rows*pitch);
+            }
+
+            GL_CALL(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+
+            for(int i = 0; i < upload_count; ++i)
+            {
+                ImageUpload* upload = &uploads[i];
+                ImageSlot* slot = upload->slot;
+                atlas_upload_rect(&slot->region, 0, upload->row, slot->w, upload->rows, (U8*)(uintptr_t)upload->offset, slot->w);
+            }
+        }
+
+        GL_CALL(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+        images.pbo = (images.pbo+1) % IMAGE_PBO_COUNT;
+
+        pthread_mutex_lock(&images.mutex);
+
+        for(int i = 0; i < upload_count && mapped; ++i)
+        {
+            ImageSlot* slot = uploads[i].slot;
+            slot->uploaded_rows += uploads[i].rows;
+
+            if(slot->uploaded_rows < slot->h)
+                continue;
+
+            stbi_image_free(slot->pixels);
+            slot->pixels = NULL;
+            images.decoded_bytes -= slot->bytes;
+            slot->state = IMAGE_STATE_READY;
+            freed = true;
+        }
+
+        pthread_mutex_unlock(&images.mutex);
+    }
+
+    if(freed)
+        pthread_cond_broadcast(&images.wake);
+}
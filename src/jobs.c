@@ -0,0 +1,69 @@
+//
+// Jobs
+//
+// Work handed to a worker thread so it overlaps with the main thread, used
+// at startup to decode and parse assets while the window and GL context
+// come up. Every job gets its own thread, there are only a few and they're
+// short lived. Job results are only read after job_wait().
+//
+// API:
+//
+// void job_start(Job* job, const char* name, JobFunc func, void* arg); // runs inline if no thread can be created
+// void job_wait(Job* job); // logs how long the job ran and how long it was waited for
+//
+
+typedef void (*JobFunc)(void* arg);
+
+typedef struct
+{
+    const char* name;
+    JobFunc func;
+    void* arg;
+
+    pthread_t thread;
+    bool started;
+    bool threaded;
+
+    double start_time;
+    double end_time;
+} Job;
+
+static void* job_thread(void* arg)
+{
+    Job* job = (Job*)arg;
+
+    job->start_time = timer_get_time();
+    job->func(job->arg);
+    job->end_time = timer_get_time();
+
+    return NULL;
+}
+
+void job_start(Job* job, const char* name, JobFunc func, void* arg)
+{
+    memset(job, 0, sizeof(Job));
+    job->name = name;
+    job->func = func;
+    job->arg = arg;
+    job->started = true;
+
+    job->threaded = (pthread_create(&job->thread, NULL, job_thread, job) == 0);
+    if(!job->threaded)
+        job_thread(job);
+}
+
+void job_wait(Job* job)
+{
+    if(!job->started)
+        return;
+
+    double wait_start = timer_get_time();
+
+    if(job->threaded)
+        pthread_join(job->thread, NULL);
+
+    double waited = MAX(0.0, timer_get_time() - wait_start);
+    job->started = false;
+
+    logi("Job %s: %.2f ms%s, waited %.2f ms", job->name, 1000.0*(job->end_time - job->start_time), job->threaded ? "" : " (inline)", 1000.0*waited);
+}
@@ -9,9 +9,15 @@
 
 // Local libs
 #include "base.h"
+#include "jobs.c"
 #include "window.c"
 #include "shader.c"
+#include "ttf.c"
+#include "font_pack.c"
+#include "atlas.c"
+#include "image.c"
 #include "draw.c"
+#include "hud.c"
 #include "ui_core.c"
 
 #define VIEW_WIDTH   1200
@@ -24,15 +30,34 @@
 bool paused = false;
 Timer main_timer = {0};
 
+// command line options
+//
+// --headless [WxH]  render offscreen without a window, WxH defaults to the view size
+// --frames N        number of frames to run in headless mode (default 60)
+// --redraw          redraw every frame even if nothing changed
+// --dump path.ppm   writes the final framebuffer before exiting, needs --headless
+// --hud             shows the performance hud
+static struct
+{
+    bool hud;
+    bool headless;
+    int width;
+    int height;
+    int frames;
+    bool redraw;
+    char* dump_path;
+} options = {0};
+
 // =========================
 // Function Prototypes
 // =========================
 
 void start_gui();
+void parse_args(int argc, char* argv[]);
 void init();
 void deinit();
 //void simulate(double);
-void draw();
+bool draw();
 
 // =========================
 // Main Loop
@@ -46,7 +71,13 @@ int main(int argc, char* argv[])
     
     time_t t;
     srand((unsigned) time(&t));
-    
+
+    parse_args(argc, argv);
+
+    // asset decoding runs on workers while the window and GL come up
+    init_timer();
+    draw_start_loading();
+
     init();
     
     timer_set_fps(&main_timer,TARGET_FPS);
@@ -57,10 +88,15 @@ int main(int argc, char* argv[])
     double accum = 0.0;
     
     const double dt = 1.0/TARGET_FPS;
+
+    int frame_count = 0;
     
     // main game loop
     for(;;)
     {
+        if(options.headless && frame_count >= options.frames)
+            window_set_close(1);
+
         new_time = timer_get_time();
         double frame_time = new_time - curr_time;
         curr_time = new_time;
@@ -70,6 +106,9 @@ int main(int argc, char* argv[])
         window_poll_events();
         if(window_should_close())
             break;
+
+        if(window_take_damage() || options.redraw)
+            draw_invalidate();
         
         while(accum >= dt)
         {
@@ -77,24 +116,102 @@ int main(int argc, char* argv[])
             accum -= dt;
         }
         
-        draw();
-        
-        timer_wait_for_frame(&main_timer);
+        bool presented = draw();
+        frame_count++;
+
+        if(frame_count == 1)
+            logi("First frame: %.1f ms after start", 1000.0*timer_get_time());
+
+        double gpu_ms;
+        if(draw_take_gpu_time(&gpu_ms))
+            timer_set_gpu_time(&main_timer, gpu_ms);
+
+        hud_frame_end(&main_timer);
+
+        // headless runs as fast as it can
+        if(!options.headless)
+            timer_wait_for_frame(&main_timer);
 
-        window_swap_buffers();
+        // unchanged frames aren't redrawn, so keep showing the last one
+        if(presented)
+            window_swap_buffers();
         window_mouse_update_actions();
     }
     
+    if(options.dump_path)
+        window_dump_framebuffer(options.dump_path);
+
     deinit();
     return 0;
 }
 
+void parse_args(int argc, char* argv[])
+{
+    options.width = VIEW_WIDTH;
+    options.height = VIEW_HEIGHT;
+    options.frames = 60;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        char* arg = argv[i];
+
+        if(STR_EQUAL(arg, "--headless"))
+        {
+            options.headless = true;
+
+            int w, h;
+            if(i+1 < argc && sscanf(argv[i+1], "%dx%d", &w, &h) == 2 && w > 0 && h > 0)
+            {
+                options.width = w;
+                options.height = h;
+                i++;
+            }
+        }
+        else if(STR_EQUAL(arg, "--frames") && i+1 < argc)
+        {
+            options.frames = atoi(argv[++i]);
+        }
+        else if(STR_EQUAL(arg, "--redraw"))
+        {
+            options.redraw = true;
+        }
+        else if(STR_EQUAL(arg, "--dump") && i+1 < argc)
+        {
+            options.dump_path = argv[++i];
+        }
+        else if(STR_EQUAL(arg, "--hud"))
+        {
+            options.hud = true;
+        }
+        else
+        {
+            logw("Unknown argument: %s", arg);
+        }
+    }
+
+    if(options.dump_path && !options.headless)
+    {
+        logw("--dump only works with --headless, ignoring it");
+        options.dump_path = NULL;
+    }
+}
+
 void init()
 {
-    init_timer();
+    double stage = timer_get_time();
     
-    logi("Resolution: %d %d",VIEW_WIDTH, VIEW_HEIGHT);
-    bool success = window_init(VIEW_WIDTH, VIEW_HEIGHT, false);
+    bool success;
+
+    if(options.headless)
+    {
+        logi("Resolution: %d %d (headless)", options.width, options.height);
+        success = window_init_headless(options.width, options.height);
+    }
+    else
+    {
+        logi("Resolution: %d %d",VIEW_WIDTH, VIEW_HEIGHT);
+        success = window_init(VIEW_WIDTH, VIEW_HEIGHT, false);
+    }
     
     if(!success)
     {
@@ -102,26 +219,52 @@ void init()
         exit(1);
     }
     
+    double window_ms = 1000.0*(timer_get_time() - stage);
+    stage = timer_get_time();
+
     logi("Initializing...");
     
     logi(" - Shaders.");
     shader_load_all();
 
+    double shaders_ms = 1000.0*(timer_get_time() - stage);
+    stage = timer_get_time();
+
     logi(" - Graphics.");
     draw_init();
+    hud_set_enabled(options.hud);
+
+    double graphics_ms = 1000.0*(timer_get_time() - stage);
     
-    logi(" Init Complete.");
+    logi(" Init Complete (window %.1f ms, shaders %.1f ms, graphics %.1f ms).", window_ms, shaders_ms, graphics_ms);
     
 }
 
 void deinit()
 {
+    DrawStats stats = draw_get_stats();
+    logi("Frames drawn: %llu, skipped: %llu", (unsigned long long)stats.frames_drawn, (unsigned long long)stats.frames_skipped);
+    logi("GPU time: %.3f ms (avg %.3f ms)", main_timer.gpu_ms, main_timer.gpu_ms_avg);
+
+    image_deinit();
+    atlas_deinit();
     shader_deinit();
     window_deinit();
 }
 
-void draw()
+bool draw()
 {
+    // the ui layout pass goes here, for now the scene is placed by hand and
+    // only the input it's placed with is read
+    hud_phase_begin(HUD_PHASE_LAYOUT);
+
+    float mx, my;
+    window_get_mouse_coords(&mx, &my);
+
+    hud_phase_end(HUD_PHASE_LAYOUT);
+
+    hud_phase_begin(HUD_PHASE_BUILD);
+
     draw_clear_screen(0.1,0.1,0.1);
 
     // draw stuff
@@ -135,11 +278,15 @@ void draw()
     draw_rect_hgrad(240,240,120,120,colora(1.0,0.0,1.0,0.5), colora(0.0,1.0,1.0,0.5));
     draw_set_rect_corner_radius(2);
 
-    float mx, my;
-    window_get_mouse_coords(&mx, &my);
-
     draw_string(14,14,0.3, WHITE, "Hello\nKam");
     draw_string(4,view_height - 64,0.8, YELLOW, "Mouse: %.0f, %.0f", mx, my);
 
-    draw_commit();
+    hud_phase_end(HUD_PHASE_BUILD);
+    hud_draw();
+
+    hud_phase_begin(HUD_PHASE_COMMIT);
+    bool presented = draw_commit();
+    hud_phase_end(HUD_PHASE_COMMIT);
+
+    return presented;
 }
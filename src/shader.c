@@ -1,10 +1,35 @@
 #define SHADER_DIR "src/shaders"
-#define MAX_SHADER_LEN 4096
+#define MAX_SHADER_LEN 16384
 #define INVALID_UNIFORM_LOCATION 0xFFFFFFFF
 
-GLuint program;
-
-static void shader_add(GLuint program, GLenum shader_type, const char* shader_file_path);
+// variants of the basic shaders, each compiled with only the code its
+// kind of instance needs. The order is also the pipeline sort order in draw.c
+typedef enum
+{
+    SHADER_BASIC_RECT_SHARP,   // solid or gradient, no sdf
+    SHADER_BASIC_RECT_ROUNDED, // rounded corners and/or soft edges
+    SHADER_BASIC_RECT_BORDER,  // rounded with a border
+    SHADER_BASIC_TEXT,         // msdf glyphs
+    SHADER_BASIC_IMAGE,        // tinted atlas images
+    SHADER_BASIC_SHAPE,        // sdf lines, circles and rings
+    SHADER_BASIC_GENERIC,      // branches per instance, never queued with
+
+    SHADER_BASIC_VARIANT_COUNT
+} ShaderBasicVariant;
+
+static const char* shader_basic_variant_defines[SHADER_BASIC_VARIANT_COUNT] = {
+    "#define PIPELINE_RECT_SHARP\n",
+    "#define PIPELINE_RECT_ROUNDED\n",
+    "#define PIPELINE_RECT_BORDER\n",
+    "#define PIPELINE_TEXT\n",
+    "#define PIPELINE_IMAGE\n",
+    "#define PIPELINE_SHAPE\n",
+    "#define PIPELINE_GENERIC\n",
+};
+
+GLuint basic_programs[SHADER_BASIC_VARIANT_COUNT];
+
+static void shader_add(GLuint program, GLenum shader_type, const char* shader_file_path, const char* defines);
 
 int read_file(const char* filepath, char* ret_buf, uint32_t max_buffer_size)
 {
@@ -33,7 +58,9 @@ int read_file(const char* filepath, char* ret_buf, uint32_t max_buffer_size)
     return i;
 }
 
-void shader_add(GLuint program, GLenum shader_type, const char* shader_file_path)
+// defines (may be NULL) are injected right after the #version line,
+// which has to stay the first line of the shader
+void shader_add(GLuint program, GLenum shader_type, const char* shader_file_path, const char* defines)
 {
     // create
 	GLuint shader_id = glCreateShader(shader_type);
@@ -58,11 +85,35 @@ void shader_add(GLuint program, GLenum shader_type, const char* shader_file_path
         free(buf);
         return;
     }
+    if(len >= MAX_SHADER_LEN)
+    {
+        fprintf(stderr, "Shader %s is larger than %d bytes\n", shader_file_path, MAX_SHADER_LEN);
+        free(buf);
+        return;
+    }
 
 	// compile
 	printf("Compiling shader: %s (size: %d bytes)\n", shader_file_path, len);
 
-	glShaderSource(shader_id, 1, (const char**)&buf, NULL);
+    const char* sources[4] = {buf, "", "", ""};
+    GLint lengths[4] = {len, 0, 0, 0};
+
+    char* body = strchr(buf, '\n');
+    if(defines && body && STRN_EQUAL(buf, "#version", 8))
+    {
+        body++;
+
+        sources[0] = buf;
+        lengths[0] = body - buf;
+        sources[1] = defines;
+        lengths[1] = strlen(defines);
+        sources[2] = "#line 2\n"; // keep error line numbers matching the file
+        lengths[2] = 8;
+        sources[3] = body;
+        lengths[3] = len - lengths[0];
+    }
+
+	glShaderSource(shader_id, 4, sources, lengths);
 	glCompileShader(shader_id);
 
 	// validate
@@ -82,12 +133,12 @@ void shader_add(GLuint program, GLenum shader_type, const char* shader_file_path
     free(buf);
 }
 
-void shader_build_program(GLuint* p, const char* vert_shader_path, const char* frag_shader_path)
+void shader_build_program_variant(GLuint* p, const char* vert_shader_path, const char* frag_shader_path, const char* defines)
 {
 	*p = glCreateProgram();
 
-    shader_add(*p, GL_VERTEX_SHADER,  vert_shader_path);
-    shader_add(*p, GL_FRAGMENT_SHADER,frag_shader_path);
+    shader_add(*p, GL_VERTEX_SHADER,  vert_shader_path, defines);
+    shader_add(*p, GL_FRAGMENT_SHADER,frag_shader_path, defines);
 
 	glLinkProgram(*p);
 
@@ -102,17 +153,27 @@ void shader_build_program(GLuint* p, const char* vert_shader_path, const char* f
 	}
 }
 
+void shader_build_program(GLuint* p, const char* vert_shader_path, const char* frag_shader_path)
+{
+    shader_build_program_variant(p, vert_shader_path, frag_shader_path, NULL);
+}
+
 void shader_load_all()
 {
-    shader_build_program(&program,
-        SHADER_DIR "/basic.vert.glsl",
-        SHADER_DIR "/basic.frag.glsl"
-    );
+    for(int i = 0; i < SHADER_BASIC_VARIANT_COUNT; ++i)
+    {
+        shader_build_program_variant(&basic_programs[i],
+            SHADER_DIR "/basic.vert.glsl",
+            SHADER_DIR "/basic.frag.glsl",
+            shader_basic_variant_defines[i]
+        );
+    }
 }
 
 void shader_deinit()
 {
-    glDeleteProgram(program);
+    for(int i = 0; i < SHADER_BASIC_VARIANT_COUNT; ++i)
+        glDeleteProgram(basic_programs[i]);
 }
 
 void shader_set_int(GLuint program, const char* name, int i)
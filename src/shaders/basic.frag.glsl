@@ -1,7 +1,13 @@
 #version 330 core
 
+// shape flags, need to match DrawRectFlag in draw.c
+#define FLAG_LINE      16u
+#define FLAG_CIRCLE    32u
+#define FLAG_LINE_FLIP 64u  // from the top right to the bottom left corner
+#define FLAG_LINE_BUTT 128u // flat caps at the end points
+
 in vec4 color0;
-in vec2 uv0;
+in vec3 uv0;
 
 in vec2 dst_half_size0;
 in vec2 dst_center0;
@@ -9,14 +15,16 @@ in vec2 dst_pos0;
 in float corner_radius0;
 in float edge_softness0;
 in float border_thickness0;
+flat in uint flags0;
+flat in uint pipeline0;
 
 out vec4 frag_color;
 
-uniform sampler2D font_image;
+uniform sampler2DArray atlas;
 
 float screenPxRange() {
-    vec2 unitRange = vec2(4.0)/vec2(textureSize(font_image, 0));
-    vec2 screenTexSize = vec2(1.0)/fwidth(uv0);
+    vec2 unitRange = vec2(4.0)/vec2(textureSize(atlas, 0).xy);
+    vec2 screenTexSize = vec2(1.0)/fwidth(uv0.xy);
     return max(0.5*dot(unitRange, screenTexSize), 1.0);
 }
 
@@ -30,51 +38,139 @@ float RoundedRectSDF(vec2 sample_pos,vec2 rect_center,vec2 rect_half_size,float
     return min(max(d2.x, d2.y), 0.0) + length(max(d2, 0.0)) - r;
 }
 
-void main()
+// segment from a to b, r is half the thickness
+float LineSDF(vec2 sample_pos, vec2 a, vec2 b, float r, bool butt)
+{
+    vec2 pa = sample_pos - a;
+    vec2 ba = b - a;
+
+    float len2 = dot(ba, ba);
+    float h = (len2 > 0.0) ? dot(pa, ba)/len2 : 0.0;
+
+    if(!butt)
+        return length(pa - ba*clamp(h, 0.0, 1.0)) - r;
+
+    // distance across the line and past its ends
+    float across = length(pa - ba*h);
+    float along = (max(-h, h - 1.0))*sqrt(len2);
+    return max(across - r, along);
+}
+
+// pipeline ids, need to match ShaderBasicVariant in shader.c
+#define PIPELINE_ID_RECT_SHARP   0u
+#define PIPELINE_ID_RECT_ROUNDED 1u
+#define PIPELINE_ID_RECT_BORDER  2u
+#define PIPELINE_ID_TEXT         3u
+#define PIPELINE_ID_IMAGE        4u
+#define PIPELINE_ID_SHAPE        5u
+
+vec4 TextColor()
 {
-    if(uv0.x > 0.0 || uv0.y > 0.0)
+    vec3 msd = texture(atlas, uv0).rgb;
+    float sd = median(msd.r, msd.g, msd.b);
+    float screenPxDistance = screenPxRange()*(sd - 0.5);
+    float opacity = clamp(screenPxDistance + 0.5, 0.0, 1.0);
+
+    return vec4(color0.rgb, opacity*color0.a);
+}
+
+vec4 ShapeColor()
+{
+    // the quad is the bounding box of the shape, shrunk like rects are
+    // so the soft edge stays inside it
+    float softness = edge_softness0;
+    float softness_padding = max(0, softness*2-1);
+
+    float dist;
+    if((flags0 & FLAG_CIRCLE) != 0u)
     {
-        // draw font
-        vec3 msd = texture(font_image, uv0.xy).rgb;
-        float sd = median(msd.r, msd.g, msd.b);
-        float screenPxDistance = screenPxRange()*(sd - 0.5);
-        float opacity = clamp(screenPxDistance + 0.5, 0.0, 1.0);
+        float radius = min(dst_half_size0.x, dst_half_size0.y) - softness_padding;
+        dist = length(dst_pos0 - dst_center0) - radius;
 
-        frag_color = vec4(color0.rgb, opacity*color0.a);
+        // rings are the inner border_thickness of the circle
+        if(border_thickness0 > 0.0)
+            dist = abs(dist + 0.5*border_thickness0) - 0.5*border_thickness0;
     }
     else
     {
-        // basic rects
-
-        float softness = edge_softness0;
-        vec2  softness_padding = vec2(max(0, softness*2-1),max(0, softness*2-1));
-
-        // sample distance
-        float dist = RoundedRectSDF(dst_pos0,dst_center0,dst_half_size0-softness_padding, corner_radius0);
-
-        // map distance => a blend factor
-        float sdf_factor = 1.f - smoothstep(0, 2*softness, dist);
-        
-        float border_factor = 1.f;
-        if(border_thickness0 != 0.0)
-        {
-            vec2 interior_half_size = dst_half_size0 - vec2(border_thickness0);
-
-            float interior_radius_reduce_f = 
-                min(interior_half_size.x/dst_half_size0.x,
-                interior_half_size.y/dst_half_size0.y);
-            float interior_corner_radius = corner_radius0 * interior_radius_reduce_f * interior_radius_reduce_f;
-
-            // calculate sample distance from "interior"
-            float inside_d = RoundedRectSDF(dst_pos0, dst_center0,
-                                          interior_half_size-softness_padding,
-                                          interior_corner_radius);
-
-            // map distance => factor
-            float inside_f = smoothstep(0, 2*softness, inside_d);
-            border_factor = inside_f;
-        }
-
-        frag_color = color0 * sdf_factor * border_factor;
+        // end points are the quad corners inset by half the thickness
+        float r = 0.5*border_thickness0;
+        vec2 e = dst_half_size0 - vec2(r);
+        if((flags0 & FLAG_LINE_FLIP) != 0u)
+            e.x = -e.x;
+
+        dist = LineSDF(dst_pos0, dst_center0 - e, dst_center0 + e, r - softness_padding, (flags0 & FLAG_LINE_BUTT) != 0u);
     }
+
+    // at least half a px of antialiasing, even without softness
+    return color0 * (1.f - smoothstep(0, max(2*softness, 0.5), dist));
+}
+
+// rounded rects, with or without a border
+vec4 RectColor(bool border)
+{
+    float softness = edge_softness0;
+    vec2  softness_padding = vec2(max(0, softness*2-1),max(0, softness*2-1));
+
+    // sample distance
+    float dist = RoundedRectSDF(dst_pos0,dst_center0,dst_half_size0-softness_padding, corner_radius0);
+
+    // map distance => a blend factor
+    float sdf_factor = 1.f - smoothstep(0, 2*softness, dist);
+
+    float border_factor = 1.f;
+    if(border)
+    {
+        vec2 interior_half_size = dst_half_size0 - vec2(border_thickness0);
+
+        float interior_radius_reduce_f = 
+            min(interior_half_size.x/dst_half_size0.x,
+            interior_half_size.y/dst_half_size0.y);
+        float interior_corner_radius = corner_radius0 * interior_radius_reduce_f * interior_radius_reduce_f;
+
+        // calculate sample distance from "interior"
+        float inside_d = RoundedRectSDF(dst_pos0, dst_center0,
+                                      interior_half_size-softness_padding,
+                                      interior_corner_radius);
+
+        // map distance => factor
+        float inside_f = smoothstep(0, 2*softness, inside_d);
+        border_factor = inside_f;
+    }
+
+    return color0 * sdf_factor * border_factor;
+}
+
+// built once per pipeline, shader.c defines one of
+// PIPELINE_TEXT, PIPELINE_IMAGE, PIPELINE_RECT_SHARP, PIPELINE_RECT_ROUNDED,
+// PIPELINE_RECT_BORDER, PIPELINE_SHAPE or PIPELINE_GENERIC after the #version line
+void main()
+{
+#if defined(PIPELINE_TEXT)
+    frag_color = TextColor();
+#elif defined(PIPELINE_IMAGE)
+    frag_color = color0 * texture(atlas, uv0);
+#elif defined(PIPELINE_RECT_SHARP)
+    // no corners or soft edges, the quad is the rect
+    frag_color = color0;
+#elif defined(PIPELINE_SHAPE)
+    frag_color = ShapeColor();
+#elif defined(PIPELINE_RECT_BORDER)
+    frag_color = RectColor(true);
+#elif defined(PIPELINE_RECT_ROUNDED)
+    frag_color = RectColor(false);
+#else
+    // short runs of mixed kinds share this one, branching on the
+    // pipeline each instance was queued with
+    if(pipeline0 == PIPELINE_ID_TEXT)
+        frag_color = TextColor();
+    else if(pipeline0 == PIPELINE_ID_IMAGE)
+        frag_color = color0 * texture(atlas, uv0);
+    else if(pipeline0 == PIPELINE_ID_RECT_SHARP)
+        frag_color = color0;
+    else if(pipeline0 == PIPELINE_ID_SHAPE)
+        frag_color = ShapeColor();
+    else
+        frag_color = RectColor(pipeline0 == PIPELINE_ID_RECT_BORDER);
+#endif
 }
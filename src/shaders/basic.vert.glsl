@@ -1,56 +1,98 @@
 #version 330 core
 
+// instance quantization, needs to match draw.c
+#define POS_SCALE      (1.0/8.0)
+#define SOFTNESS_SCALE (1.0/16.0)
+#define BORDER_SCALE   (1.0/4.0)
+
+#define FLAG_GRADIENT_H 1u
+#define FLAG_GRADIENT_V 2u
+#define FLAG_LINE       16u
+#define FLAG_CIRCLE     32u
+
 uniform vec2 res; // resolution
 uniform vec2 verts[4];
 
-uniform sampler2D font_image;
+uniform sampler2DArray atlas;
 
-layout (location = 0)  in vec2 dst_p0; // top-left on screen
-layout (location = 1)  in vec2 dst_p1; // bottom-right on screen
-layout (location = 2)  in vec2 src_p0; // top-left of texture
-layout (location = 3)  in vec2 src_p1; // bottom-left of texture
-layout (location = 4)  in vec4 colors[4]; // takes up for slots
-layout (location = 8)  in float corner_radius;
-layout (location = 9)  in float edge_softness;
-layout (location = 10) in float border_thickness;
+layout (location = 0) in vec4  dst_rect; // top-left, bottom-right on screen
+layout (location = 1) in vec4  src_rect; // top-left, bottom-right of texture
+layout (location = 2) in vec4  color1;
+layout (location = 3) in vec4  color2;
+layout (location = 4) in uvec4 style;    // corner_radius, edge_softness, border_thickness, flags
+layout (location = 5) in vec4  clip_rect; // top-left, bottom-right of the clip rect
+layout (location = 6) in uvec2 layer;     // atlas page, pipeline
+layout (location = 7) in float depth;     // draw order, 0 to 1 front most
 
 // outputs
 
 out vec4 color0;
-out vec2 uv0;
+out vec3 uv0;
 out vec2 dst_half_size0;
 out vec2 dst_center0;
 out vec2 dst_pos0;
 out float corner_radius0;
 out float edge_softness0;
 out float border_thickness0;
+flat out uint flags0;
+flat out uint pipeline0;
 
 void main()
 {
+    vec2 dst_p0 = dst_rect.xy * POS_SCALE;
+    vec2 dst_p1 = dst_rect.zw * POS_SCALE;
+    vec2 src_p0 = src_rect.xy;
+    vec2 src_p1 = src_rect.zw;
+
+    vec2 vert = verts[gl_VertexID];
 
     vec2 dst_half_size = (dst_p1 - dst_p0) / 2.0;
     vec2 dst_center    = (dst_p1 + dst_p0) / 2.0;
-    vec2 dst_pos       = (verts[gl_VertexID] * dst_half_size + dst_center);
 
-    vec2 src_half_size = (src_p1 - src_p0) / 2.0;
-    vec2 src_center    = (src_p1 + src_p0) / 2.0;
-    vec2 src_pos       = (verts[gl_VertexID] * src_half_size + src_center);
+    // shrink the quad to the clip rect. everything else is derived from
+    // where the vertex ends up inside the unclipped rect, so the sdf,
+    // uvs and gradient are unaffected by the clipping
+    vec2 clip_p0 = max(dst_p0, clip_rect.xy * POS_SCALE);
+    vec2 clip_p1 = max(clip_p0, min(dst_p1, clip_rect.zw * POS_SCALE));
+
+    vec2 dst_pos = mix(clip_p0, clip_p1, vert*0.5 + 0.5);
+    vec2 t_pos   = (dst_pos - dst_p0) / max(dst_p1 - dst_p0, vec2(1e-6));
 
+    vec2 src_pos = mix(src_p0, src_p1, t_pos);
+
+    // later in the draw order is closer, for the opaque depth pass
     gl_Position = vec4(2.0 * dst_pos.x / res.x - 1.0,
                        2.0 * dst_pos.y / res.y - 1.0,
-                       0.0,
+                       1.0 - 2.0 * depth,
                        1.0);
 
     gl_Position.y *= -1;
 
-    color0 = colors[gl_VertexID];
-    uv0 = vec2(src_pos.x, src_pos.y);
+    uint flags = style.w;
+
+    float t = 0.0;
+    if((flags & FLAG_GRADIENT_H) != 0u)
+        t = t_pos.x;
+    else if((flags & FLAG_GRADIENT_V) != 0u)
+        t = t_pos.y;
+
+    color0 = mix(color1, color2, t);
+    uv0 = vec3(src_pos.x, src_pos.y, float(layer.x));
 
     dst_half_size0 = dst_half_size;
     dst_center0 = dst_center;
     dst_pos0 = dst_pos;
     
-    corner_radius0 = corner_radius;
-    edge_softness0 = edge_softness;
-    border_thickness0 = border_thickness;
+    corner_radius0 = float(style.x);
+    edge_softness0 = float(style.y) * SOFTNESS_SCALE;
+    border_thickness0 = float(style.z) * BORDER_SCALE;
+
+    // shapes have no corners, corner_radius is the high byte of their thickness
+    if((flags & (FLAG_LINE | FLAG_CIRCLE)) != 0u)
+    {
+        corner_radius0 = 0.0;
+        border_thickness0 = float((style.x << 8) | style.z) * BORDER_SCALE;
+    }
+    flags0 = flags;
+    pipeline0 = layer.y;
 }
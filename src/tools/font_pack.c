@@ -0,0 +1,156 @@
+//
+// Font Pack Tool
+//
+// Builds the font pack load_font() maps (see font_pack.c) from the png and
+// csv files of the baked font. Run it from the repository root after
+// regenerating the font, the pack isn't checked against its sources.
+//
+// With --kern the kerning csv is first rewritten from the kern table of the
+// ttf the atlas was baked from, without rebaking the atlas. The ttf's
+// advances have to match the layout, pairs of another font would be wrong.
+//
+// usage: font_pack [image.png layout.csv kerning.csv out.fontpack] [--kern font.ttf]
+//
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_PNG
+#include "../stb/stb_image.h"
+
+#include "../base.h"
+#include "../ttf.c"
+#include "../font_pack.c"
+
+// writes the pairs of the ttf between baked chars to kerning_path
+static bool kerning_from_ttf(const char* ttf_path, const char* layout_path, const char* kerning_path)
+{
+    FontChar chars[FONT_PACK_CHARS];
+    if(!font_layout_parse(layout_path, 0, chars))
+        return false;
+
+    TtfFont font;
+    if(!ttf_load(&font, ttf_path))
+    {
+        loge("Failed to load font: %s", ttf_path);
+        return false;
+    }
+
+    // baked chars by glyph, several code points can share one
+    int* glyph_chars = (int*)malloc(font.glyph_count*sizeof(int));
+    int* next_char = (int*)malloc(FONT_PACK_CHARS*sizeof(int));
+    for(int i = 0; i < font.glyph_count; ++i)
+        glyph_chars[i] = -1;
+
+    int mismatched = 0;
+    for(int c = 1; c < FONT_PACK_CHARS; ++c)
+    {
+        next_char[c] = -1;
+
+        if(chars[c].advance == 0.0f)
+            continue;
+
+        int glyph = ttf_find_glyph(&font, c);
+        if(glyph <= 0 || glyph >= font.glyph_count)
+            continue;
+
+        // layout advances are the font units over units_per_em
+        int advance, lsb;
+        ttf_get_hmetrics(&font, glyph, &advance, &lsb);
+        if(fabsf(advance/(float)font.units_per_em - chars[c].advance) > 0.5f/font.units_per_em)
+            mismatched++;
+
+        next_char[c] = glyph_chars[glyph];
+        glyph_chars[glyph] = c;
+    }
+
+    bool written = false;
+
+    if(mismatched > 0)
+    {
+        loge("%s has %d advances that differ from %s, it's not the font the atlas was baked from", ttf_path, mismatched, layout_path);
+    }
+    else
+    {
+        TtfKernPair* pairs;
+        int pair_count = ttf_get_kerning(&font, &pairs);
+
+        FILE* fp = fopen(kerning_path, "w");
+        if(fp)
+        {
+            int count = 0;
+            for(int i = 0; i < pair_count; ++i)
+            {
+                if(pairs[i].left >= font.glyph_count || pairs[i].right >= font.glyph_count)
+                    continue;
+
+                for(int l = glyph_chars[pairs[i].left]; l >= 0; l = next_char[l])
+                {
+                    for(int r = glyph_chars[pairs[i].right]; r >= 0; r = next_char[r])
+                    {
+                        fprintf(fp, "%d,%d,%.9g\n", l, r, pairs[i].value/(double)font.units_per_em);
+                        count++;
+                    }
+                }
+            }
+
+            written = (fclose(fp) == 0);
+            if(written)
+                logi("Wrote %s (%d of %d pairs in %s are between baked chars)", kerning_path, count, pair_count, ttf_path);
+        }
+        else
+        {
+            loge("Failed to open %s for writing", kerning_path);
+        }
+
+        free(pairs);
+    }
+
+    free(glyph_chars);
+    free(next_char);
+    ttf_free(&font);
+
+    return written;
+}
+
+int main(int argc, char* argv[])
+{
+    const char* image_path   = "src/fonts/atlas.png";
+    const char* layout_path  = "src/fonts/atlas_layout.csv";
+    const char* kerning_path = "src/fonts/atlas_kerning.csv";
+    const char* pack_path    = "src/fonts/atlas.fontpack";
+    const char* ttf_path     = NULL;
+
+    if(argc >= 3 && strcmp(argv[argc-2], "--kern") == 0)
+    {
+        ttf_path = argv[argc-1];
+        argc -= 2;
+    }
+
+    if(argc == 5)
+    {
+        image_path = argv[1];
+        layout_path = argv[2];
+        kerning_path = argv[3];
+        pack_path = argv[4];
+    }
+    else if(argc != 1)
+    {
+        printf("usage: %s [image.png layout.csv kerning.csv out.fontpack] [--kern font.ttf]\n", argv[0]);
+        return 1;
+    }
+
+    if(ttf_path && !kerning_from_ttf(ttf_path, layout_path, kerning_path))
+        return 1;
+
+    // never from an existing pack, this is what makes it
+    FontSource source;
+    if(!font_source_load(&source, NULL, image_path, layout_path, kerning_path))
+        return 1;
+
+    bool written = font_pack_write(pack_path, source.chars, source.kerns, source.kern_count, source.w, source.h, source.pixels);
+    if(written)
+        logi("Wrote %s (%dx%d, %d kerning pairs)", pack_path, source.w, source.h, source.kern_count);
+
+    font_source_free(&source);
+
+    return written ? 0 : 1;
+}
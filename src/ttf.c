@@ -0,0 +1,845 @@
+//
+// TrueType Fonts
+//
+// Minimal reader for TrueType outlines (.ttf and the first font of a .ttc)
+// and a rasterizer that turns a glyph into a signed distance field. The
+// field is written into the rgb channels alike, the median in the msdf
+// text shader then is the distance itself, so runtime glyphs draw through
+// the same pipeline as the baked atlas.
+//
+// API:
+//
+// bool ttf_load(TtfFont* font, const char* path);
+// void ttf_free(TtfFont* font);
+// int  ttf_find_glyph(TtfFont* font, U32 codepoint); // 0 (the missing glyph) if the font doesn't have it
+// void ttf_get_hmetrics(TtfFont* font, int glyph, int* advance, int* lsb); // font units
+// bool ttf_get_glyph_box(TtfFont* font, int glyph, int* x0, int* y0, int* x1, int* y1); // font units, false if empty
+// void ttf_render_sdf(TtfFont* font, int glyph, float scale, float x0, float y1, float range, U8* rgba, int w, int h, int stride);
+// int  ttf_get_kerning(TtfFont* font, TtfKernPair** pairs); // pair count, *pairs is malloc'd
+//
+
+#define TTF_MAX_COMPONENT_DEPTH 8
+#define TTF_MAX_CURVE_STEPS 16
+
+typedef struct
+{
+    U8* data;
+    U32 size;
+
+    int glyph_count;
+    int units_per_em;
+    int ascent, descent, line_gap;
+    int hmetric_count;
+    int loca_long; // indexToLocFormat
+
+    // table offsets into data, 0 if missing, and their lengths. Every read
+    // is checked against the table it's in
+    U32 cmap, cmap_length; // the subtable that's used
+    U32 loca, loca_length;
+    U32 glyf, glyf_length;
+    U32 hmtx, hmtx_length;
+    U32 kern, kern_length;
+} TtfFont;
+
+typedef struct
+{
+    U16 left, right; // glyphs
+    I16 value;       // font units, added to the advance of left
+} TtfKernPair;
+
+// outline flattened to line segments, in pixels
+typedef struct
+{
+    float* xy; // x0,y0,x1,y1 per segment
+    int count;
+    int capacity;
+
+    // font units to pixels
+    float scale;
+    float x0, y1;
+} TtfShape;
+
+static inline U16 ttf_u16(U8* p) { return (U16)(p[0] << 8 | p[1]); }
+static inline I16 ttf_i16(U8* p) { return (I16)ttf_u16(p); }
+static inline U32 ttf_u32(U8* p) { return ((U32)p[0] << 24) | ((U32)p[1] << 16) | ((U32)p[2] << 8) | p[3]; }
+
+// true if 'size' bytes at 'offset' are inside 'length' bytes, in 64 bits so
+// offsets from the file can't wrap around
+static inline bool ttf_fits(U32 length, U64 offset, U64 size)
+{
+    return offset + size <= length;
+}
+
+static U32 ttf_find_table(TtfFont* font, U32 font_offset, const char* tag, U32* length)
+{
+    U8* d = font->data;
+    *length = 0;
+
+    if(!ttf_fits(font->size, font_offset, 12))
+        return 0;
+
+    int table_count = ttf_u16(d + font_offset + 4);
+
+    for(int i = 0; i < table_count; ++i)
+    {
+        U64 record = (U64)font_offset + 12 + 16*i;
+        if(!ttf_fits(font->size, record, 16))
+            break;
+
+        if(memcmp(d + record, tag, 4) == 0)
+        {
+            U32 offset = ttf_u32(d + record + 8);
+            U32 table_length = ttf_u32(d + record + 12);
+            if(offset == 0 || !ttf_fits(font->size, offset, table_length))
+                return 0;
+
+            *length = table_length;
+            return offset;
+        }
+    }
+
+    return 0;
+}
+
+// unicode subtable, full repertoire (format 12) preferred over the BMP (format 4)
+static U32 ttf_find_cmap(TtfFont* font, U32 cmap, U32 cmap_length, U32* length)
+{
+    U8* d = font->data;
+    *length = 0;
+
+    if(cmap_length < 4)
+        return 0;
+
+    int count = ttf_u16(d + cmap + 2);
+
+    U32 bmp = 0, bmp_length = 0;
+    for(int i = 0; i < count; ++i)
+    {
+        if(!ttf_fits(cmap_length, 4 + 8*i, 8))
+            break;
+
+        U8* record = d + cmap + 4 + 8*i;
+        int platform = ttf_u16(record);
+        int encoding = ttf_u16(record + 2);
+        U32 offset = ttf_u32(record + 4);
+
+        // long enough for either header
+        if(!ttf_fits(cmap_length, offset, 16))
+            continue;
+
+        bool unicode = (platform == 0) || (platform == 3 && (encoding == 1 || encoding == 10));
+        if(!unicode)
+            continue;
+
+        // the subtable's own length, cut off at the end of the cmap
+        U8* sub = d + cmap + offset;
+        U32 available = cmap_length - offset;
+
+        int format = ttf_u16(sub);
+        if(format == 12)
+        {
+            U32 sub_length = MIN(ttf_u32(sub + 4), available);
+            if(sub_length < 16)
+                continue;
+
+            *length = sub_length;
+            return cmap + offset;
+        }
+        if(format == 4 && !bmp)
+        {
+            U32 sub_length = MIN(ttf_u16(sub + 2), available);
+            if(sub_length < 16)
+                continue;
+
+            bmp = cmap + offset;
+            bmp_length = sub_length;
+        }
+    }
+
+    *length = bmp_length;
+    return bmp;
+}
+
+void ttf_free(TtfFont* font)
+{
+    free(font->data);
+    memset(font, 0, sizeof(TtfFont));
+}
+
+bool ttf_load(TtfFont* font, const char* path)
+{
+    memset(font, 0, sizeof(TtfFont));
+
+    FILE* fp = fopen(path, "rb");
+    if(!fp)
+        return false;
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    if(size < 12)
+    {
+        fclose(fp);
+        return false;
+    }
+
+    font->data = (U8*)malloc(size);
+    font->size = (U32)size;
+
+    bool read = (fread(font->data, 1, size, fp) == (size_t)size);
+    fclose(fp);
+
+    if(!read)
+    {
+        ttf_free(font);
+        return false;
+    }
+
+    // collections start with their own header, use the first font
+    U32 font_offset = 0;
+    if(memcmp(font->data, "ttcf", 4) == 0)
+        font_offset = (font->size >= 16) ? ttf_u32(font->data + 12) : font->size;
+
+    U32 head_length, maxp_length, hhea_length, cmap_length;
+    U32 head = ttf_find_table(font, font_offset, "head", &head_length);
+    U32 maxp = ttf_find_table(font, font_offset, "maxp", &maxp_length);
+    U32 hhea = ttf_find_table(font, font_offset, "hhea", &hhea_length);
+    U32 cmap = ttf_find_table(font, font_offset, "cmap", &cmap_length);
+
+    font->loca = ttf_find_table(font, font_offset, "loca", &font->loca_length);
+    font->glyf = ttf_find_table(font, font_offset, "glyf", &font->glyf_length);
+    font->hmtx = ttf_find_table(font, font_offset, "hmtx", &font->hmtx_length);
+    font->kern = ttf_find_table(font, font_offset, "kern", &font->kern_length);
+
+    // no glyf table means cff outlines, which aren't supported. The fixed
+    // size tables need to be long enough for the fields that are read
+    if(!head || !maxp || !hhea || !cmap || !font->loca || !font->glyf || !font->hmtx ||
+       head_length < 54 || maxp_length < 6 || hhea_length < 36)
+    {
+        logw("Unsupported font file: %s", path);
+        ttf_free(font);
+        return false;
+    }
+
+    U8* d = font->data;
+
+    font->units_per_em = ttf_u16(d + head + 18);
+    font->loca_long = ttf_i16(d + head + 50);
+    font->glyph_count = ttf_u16(d + maxp + 4);
+    font->ascent = ttf_i16(d + hhea + 4);
+    font->descent = ttf_i16(d + hhea + 6);
+    font->line_gap = ttf_i16(d + hhea + 8);
+    font->hmetric_count = ttf_u16(d + hhea + 34);
+    font->cmap = ttf_find_cmap(font, cmap, cmap_length, &font->cmap_length);
+
+    if(!font->cmap || font->units_per_em == 0)
+    {
+        logw("No unicode mapping in font: %s", path);
+        ttf_free(font);
+        return false;
+    }
+
+    return true;
+}
+
+int ttf_find_glyph(TtfFont* font, U32 codepoint)
+{
+    U8* d = font->data;
+    U32 cmap = font->cmap;
+    U32 length = font->cmap_length;
+
+    if(ttf_u16(d + cmap) == 12)
+    {
+        // only the groups that are inside the subtable
+        U32 group_count = ttf_u32(d + cmap + 12);
+        if(!ttf_fits(length, 16, 12*(U64)group_count))
+            group_count = (length - 16)/12;
+
+        // groups are sorted by start code
+        U32 lo = 0, hi = group_count;
+        while(lo < hi)
+        {
+            U32 mid = (lo + hi)/2;
+            U8* group = d + cmap + 16 + 12*mid;
+
+            U32 start = ttf_u32(group);
+            U32 end = ttf_u32(group + 4);
+
+            if(codepoint < start)
+                hi = mid;
+            else if(codepoint > end)
+                lo = mid+1;
+            else
+                return (int)(ttf_u32(group + 8) + (codepoint - start));
+        }
+
+        return 0;
+    }
+
+    // format 4, segments of the BMP
+    if(codepoint > 0xFFFF)
+        return 0;
+
+    int seg_count = ttf_u16(d + cmap + 6)/2;
+
+    // 4 arrays of seg_count values and a pad after the first one
+    if(!ttf_fits(length, 16, 8*seg_count))
+        return 0;
+
+    U8* end_codes = d + cmap + 14;
+    U8* start_codes = end_codes + 2*seg_count + 2;
+    U8* deltas = start_codes + 2*seg_count;
+    U8* range_offsets = deltas + 2*seg_count;
+
+    int lo = 0, hi = seg_count;
+    while(lo < hi)
+    {
+        int mid = (lo + hi)/2;
+        if(ttf_u16(end_codes + 2*mid) < codepoint)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+
+    if(lo >= seg_count)
+        return 0;
+
+    U32 start = ttf_u16(start_codes + 2*lo);
+    if(codepoint < start)
+        return 0;
+
+    U16 delta = ttf_u16(deltas + 2*lo);
+    U16 range_offset = ttf_u16(range_offsets + 2*lo);
+
+    if(range_offset == 0)
+        return (U16)(codepoint + delta);
+
+    // offset is relative to its own position in the range_offsets array
+    U64 at = 16 + 6*seg_count + 2*lo + range_offset + 2*(codepoint - start);
+    if(!ttf_fits(length, at, 2))
+        return 0;
+
+    U16 glyph = ttf_u16(d + cmap + at);
+    return glyph ? (U16)(glyph + delta) : 0;
+}
+
+// 0 for both if the glyph or its metrics aren't in the font
+void ttf_get_hmetrics(TtfFont* font, int glyph, int* advance, int* lsb)
+{
+    U8* d = font->data + font->hmtx;
+    U32 length = font->hmtx_length;
+    int count = font->hmetric_count;
+
+    *advance = 0;
+    *lsb = 0;
+
+    if(glyph < 0 || glyph >= font->glyph_count || count == 0)
+        return;
+
+    if(glyph < count)
+    {
+        if(!ttf_fits(length, 4*(U64)glyph, 4))
+            return;
+
+        *advance = ttf_u16(d + 4*glyph);
+        *lsb = ttf_i16(d + 4*glyph + 2);
+    }
+    else
+    {
+        // monospaced tail, shares the last advance
+        if(!ttf_fits(length, 4*(U64)(count-1), 2))
+            return;
+
+        *advance = ttf_u16(d + 4*(count-1));
+
+        U64 at = 4*(U64)count + 2*(U64)(glyph - count);
+        if(ttf_fits(length, at, 2))
+            *lsb = ttf_i16(d + at);
+    }
+}
+
+// offset of the glyph in the glyf table and its length, 0 if it has no
+// outline or isn't inside the table. Anything that is has a whole header
+static U32 ttf_glyph_offset(TtfFont* font, int glyph, U32* length)
+{
+    *length = 0;
+
+    if(glyph < 0 || glyph >= font->glyph_count)
+        return 0;
+
+    U8* loca = font->data + font->loca;
+    U32 start, end;
+
+    if(font->loca_long)
+    {
+        if(!ttf_fits(font->loca_length, 4*(U64)glyph, 8))
+            return 0;
+
+        start = ttf_u32(loca + 4*glyph);
+        end = ttf_u32(loca + 4*glyph + 4);
+    }
+    else
+    {
+        if(!ttf_fits(font->loca_length, 2*(U64)glyph, 4))
+            return 0;
+
+        start = 2*ttf_u16(loca + 2*glyph);
+        end = 2*ttf_u16(loca + 2*glyph + 2);
+    }
+
+    if(end < (U64)start + 10 || end > font->glyf_length)
+        return 0;
+
+    *length = end - start;
+    return font->glyf + start;
+}
+
+bool ttf_get_glyph_box(TtfFont* font, int glyph, int* x0, int* y0, int* x1, int* y1)
+{
+    U32 length;
+    U32 offset = ttf_glyph_offset(font, glyph, &length);
+    if(!offset)
+        return false;
+
+    U8* g = font->data + offset;
+    *x0 = ttf_i16(g + 2);
+    *y0 = ttf_i16(g + 4);
+    *x1 = ttf_i16(g + 6);
+    *y1 = ttf_i16(g + 8);
+
+    return *x1 > *x0 && *y1 > *y0;
+}
+
+static void ttf_shape_line(TtfShape* shape, float ax, float ay, float bx, float by)
+{
+    if(shape->count == shape->capacity)
+    {
+        shape->capacity = MAX(64, 2*shape->capacity);
+        shape->xy = (float*)realloc(shape->xy, shape->capacity*4*sizeof(float));
+    }
+
+    // font units (y up) to pixels (y down)
+    float* s = shape->xy + 4*shape->count++;
+    s[0] = ax*shape->scale - shape->x0;
+    s[1] = shape->y1 - ay*shape->scale;
+    s[2] = bx*shape->scale - shape->x0;
+    s[3] = shape->y1 - by*shape->scale;
+}
+
+static void ttf_shape_curve(TtfShape* shape, float ax, float ay, float cx, float cy, float bx, float by)
+{
+    // enough steps for about 2px per line at the rendered size
+    float len = (sqrtf((cx-ax)*(cx-ax) + (cy-ay)*(cy-ay)) + sqrtf((bx-cx)*(bx-cx) + (by-cy)*(by-cy)))*shape->scale;
+    int steps = CLAMP((int)(len/2.0f) + 1, 1, TTF_MAX_CURVE_STEPS);
+
+    float px = ax, py = ay;
+    for(int i = 1; i <= steps; ++i)
+    {
+        float t = i/(float)steps;
+        float u = 1.0f - t;
+
+        float x = u*u*ax + 2.0f*u*t*cx + t*t*bx;
+        float y = u*u*ay + 2.0f*u*t*cy + t*t*by;
+
+        ttf_shape_line(shape, px, py, x, y);
+        px = x;
+        py = y;
+    }
+}
+
+// adds the glyph's contours to the shape, transformed by m (2x2 + offset).
+// False if the glyph doesn't fit in its part of the glyf table, what was
+// added of it is garbage then
+static bool ttf_shape_glyph(TtfFont* font, int glyph, float m[6], TtfShape* shape, int depth)
+{
+    if(depth > TTF_MAX_COMPONENT_DEPTH)
+        return false;
+
+    U32 length;
+    U32 offset = ttf_glyph_offset(font, glyph, &length);
+    if(!offset)
+        return true;
+
+    U8* d = font->data;
+    U8* g = d + offset;
+    U8* end_of_data = g + length;
+
+    int contour_count = ttf_i16(g);
+
+    if(contour_count < 0)
+    {
+        // composite, each component is another glyph with its own transform
+        U8* p = g + 10;
+        for(;;)
+        {
+            if(p + 4 > end_of_data)
+                return false;
+
+            U16 flags = ttf_u16(p);
+            int component = ttf_u16(p + 2);
+            p += 4;
+
+            int args_size = (flags & 0x0001) ? 4 : 2;
+            int scale_size = (flags & 0x0008) ? 2 : (flags & 0x0040) ? 4 : (flags & 0x0080) ? 8 : 0;
+            if(p + args_size + scale_size > end_of_data)
+                return false;
+
+            float dx, dy;
+            if(flags & 0x0001) // ARG_1_AND_2_ARE_WORDS
+            {
+                dx = ttf_i16(p);
+                dy = ttf_i16(p + 2);
+                p += 4;
+            }
+            else
+            {
+                dx = (I8)p[0];
+                dy = (I8)p[1];
+                p += 2;
+            }
+
+            if(!(flags & 0x0002)) // ARGS_ARE_XY_VALUES, point matching isn't supported
+                dx = dy = 0.0f;
+
+            float a = 1.0f, b = 0.0f, c = 0.0f, e = 1.0f;
+            if(flags & 0x0008) // WE_HAVE_A_SCALE
+            {
+                a = e = ttf_i16(p)/16384.0f;
+                p += 2;
+            }
+            else if(flags & 0x0040) // WE_HAVE_AN_X_AND_Y_SCALE
+            {
+                a = ttf_i16(p)/16384.0f;
+                e = ttf_i16(p + 2)/16384.0f;
+                p += 4;
+            }
+            else if(flags & 0x0080) // WE_HAVE_A_TWO_BY_TWO
+            {
+                a = ttf_i16(p)/16384.0f;
+                b = ttf_i16(p + 2)/16384.0f;
+                c = ttf_i16(p + 4)/16384.0f;
+                e = ttf_i16(p + 6)/16384.0f;
+                p += 8;
+            }
+
+            // m * component transform
+            float cm[6] = {
+                m[0]*a + m[2]*b, m[1]*a + m[3]*b,
+                m[0]*c + m[2]*e, m[1]*c + m[3]*e,
+                m[0]*dx + m[2]*dy + m[4], m[1]*dx + m[3]*dy + m[5],
+            };
+
+            if(!ttf_shape_glyph(font, component, cm, shape, depth+1))
+                return false;
+
+            if(!(flags & 0x0020)) // MORE_COMPONENTS
+                return true;
+        }
+    }
+
+    if(contour_count == 0)
+        return true;
+
+    // endPtsOfContours and instructionLength
+    U8* end_points = g + 10;
+    if(end_points + 2*contour_count + 2 > end_of_data)
+        return false;
+
+    int point_count = ttf_u16(end_points + 2*(contour_count-1)) + 1;
+    int instruction_len = ttf_u16(end_points + 2*contour_count);
+
+    U8* p = end_points + 2*contour_count + 2 + instruction_len;
+    if(p > end_of_data)
+        return false;
+
+    bool complete = false;
+
+    U8* flags = (U8*)malloc(point_count);
+    float* xs = (float*)malloc(point_count*2*sizeof(float));
+    float* ys = xs + point_count;
+
+    // flags, with repeats
+    for(int i = 0; i < point_count;)
+    {
+        if(p >= end_of_data)
+            goto done;
+
+        U8 f = *p++;
+        flags[i++] = f;
+
+        if(f & 8)
+        {
+            if(p >= end_of_data)
+                goto done;
+
+            int repeat = *p++;
+            while(repeat-- > 0 && i < point_count)
+                flags[i++] = f;
+        }
+    }
+
+    // coordinates are deltas, short ones carry their sign in the flags
+    int x = 0;
+    for(int i = 0; i < point_count; ++i)
+    {
+        U8 f = flags[i];
+        if(f & 2)
+        {
+            if(p >= end_of_data)
+                goto done;
+            x += (f & 16) ? *p : -(int)*p;
+            p += 1;
+        }
+        else if(!(f & 16))
+        {
+            if(p + 2 > end_of_data)
+                goto done;
+            x += ttf_i16(p);
+            p += 2;
+        }
+        xs[i] = x;
+    }
+
+    int y = 0;
+    for(int i = 0; i < point_count; ++i)
+    {
+        U8 f = flags[i];
+        if(f & 4)
+        {
+            if(p >= end_of_data)
+                goto done;
+            y += (f & 32) ? *p : -(int)*p;
+            p += 1;
+        }
+        else if(!(f & 32))
+        {
+            if(p + 2 > end_of_data)
+                goto done;
+            y += ttf_i16(p);
+            p += 2;
+        }
+        ys[i] = y;
+    }
+
+    for(int i = 0; i < point_count; ++i)
+    {
+        float px = xs[i], py = ys[i];
+        xs[i] = m[0]*px + m[2]*py + m[4];
+        ys[i] = m[1]*px + m[3]*py + m[5];
+    }
+
+    // contours, consecutive off curve points have an implied on curve point between them
+    int first = 0;
+    for(int c = 0; c < contour_count; ++c)
+    {
+        int last = ttf_u16(end_points + 2*c);
+        if(last >= point_count || last < first)
+            break;
+
+        int n = last - first + 1;
+
+        // start on an on curve point, or the middle of the first two off curve ones
+        float sx, sy;
+        int start;
+        if(flags[first] & 1)
+        {
+            sx = xs[first]; sy = ys[first];
+            start = 1;
+        }
+        else if(flags[last] & 1)
+        {
+            sx = xs[last]; sy = ys[last];
+            start = 0;
+            n--;
+        }
+        else
+        {
+            sx = 0.5f*(xs[first] + xs[last]);
+            sy = 0.5f*(ys[first] + ys[last]);
+            start = 0;
+        }
+
+        float px = sx, py = sy;
+        bool has_control = false;
+        float cx = 0.0f, cy = 0.0f;
+
+        for(int k = start; k <= n; ++k)
+        {
+            // wraps around to close the contour at the start point
+            bool closing = (k == n);
+            int i = first + k;
+
+            bool on = closing ? true : (flags[i] & 1);
+            float qx = closing ? sx : xs[i];
+            float qy = closing ? sy : ys[i];
+
+            if(on)
+            {
+                if(has_control)
+                    ttf_shape_curve(shape, px, py, cx, cy, qx, qy);
+                else
+                    ttf_shape_line(shape, px, py, qx, qy);
+
+                px = qx; py = qy;
+                has_control = false;
+            }
+            else if(has_control)
+            {
+                float mx = 0.5f*(cx + qx);
+                float my = 0.5f*(cy + qy);
+
+                ttf_shape_curve(shape, px, py, cx, cy, mx, my);
+
+                px = mx; py = my;
+                cx = qx; cy = qy;
+            }
+            else
+            {
+                cx = qx; cy = qy;
+                has_control = true;
+            }
+        }
+
+        first = last + 1;
+    }
+
+    complete = true;
+
+done:
+    free(flags);
+    free(xs);
+
+    return complete;
+}
+
+// renders the glyph into a w x h rgba8 block, 'stride' bytes per row. Font
+// units are scaled by 'scale' and the pixel at (0,0) is at (x0,y1) in
+// scaled font units (y up). 0.5 is the outline, 'range' is the distance in
+// pixels covered by 0 to 1
+void ttf_render_sdf(TtfFont* font, int glyph, float scale, float x0, float y1, float range, U8* rgba, int w, int h, int stride)
+{
+    TtfShape shape = {0};
+    shape.scale = scale;
+    shape.x0 = x0;
+    shape.y1 = y1;
+
+    // a glyph that reads past its data renders empty
+    float identity[6] = {1.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f};
+    if(!ttf_shape_glyph(font, glyph, identity, &shape, 0))
+        shape.count = 0;
+
+    float max_dist = 0.5f*range;
+
+    for(int py = 0; py < h; ++py)
+    {
+        U8* row = rgba + py*stride;
+
+        for(int px = 0; px < w; ++px)
+        {
+            float x = px + 0.5f;
+            float y = py + 0.5f;
+
+            float min_dist2 = max_dist*max_dist;
+            int winding = 0;
+
+            for(int i = 0; i < shape.count; ++i)
+            {
+                float* s = shape.xy + 4*i;
+                float ax = s[0], ay = s[1], bx = s[2], by = s[3];
+
+                // nonzero winding from the crossings of a ray towards +x
+                if((ay <= y) != (by <= y))
+                {
+                    float cross_x = ax + (y - ay)*(bx - ax)/(by - ay);
+                    if(cross_x > x)
+                        winding += (by > ay) ? 1 : -1;
+                }
+
+                float ex = bx - ax, ey = by - ay;
+                float len2 = ex*ex + ey*ey;
+                float t = (len2 > 0.0f) ? CLAMP(((x - ax)*ex + (y - ay)*ey)/len2, 0.0f, 1.0f) : 0.0f;
+
+                float dx = ax + t*ex - x;
+                float dy = ay + t*ey - y;
+                float dist2 = dx*dx + dy*dy;
+
+                if(dist2 < min_dist2)
+                    min_dist2 = dist2;
+            }
+
+            float dist = sqrtf(min_dist2);
+            if(winding == 0)
+                dist = -dist;
+
+            U8 v = (U8)(255.0f*CLAMP(0.5f + dist/range, 0.0f, 1.0f) + 0.5f);
+
+            row[4*px+0] = v;
+            row[4*px+1] = v;
+            row[4*px+2] = v;
+            row[4*px+3] = 255;
+        }
+    }
+
+    free(shape.xy);
+}
+
+// pairs of the horizontal format 0 subtables of the kern table. kerning
+// that only lives in GPOS isn't read
+int ttf_get_kerning(TtfFont* font, TtfKernPair** pairs)
+{
+    *pairs = NULL;
+
+    U8* d = font->data + font->kern;
+    U32 kern_length = font->kern_length;
+
+    // apple's version 1 header isn't supported
+    if(!font->kern || kern_length < 4 || ttf_u16(d) != 0)
+        return 0;
+
+    int table_count = ttf_u16(d + 2);
+    int count = 0;
+
+    U32 sub = 4;
+    for(int t = 0; t < table_count && ttf_fits(kern_length, sub, 14); ++t)
+    {
+        U32 length = ttf_u16(d + sub + 2);
+        U16 coverage = ttf_u16(d + sub + 4);
+
+        if((coverage >> 8) != 0)
+        {
+            if(length == 0)
+                break;
+
+            sub += length;
+            continue;
+        }
+
+        U32 pair_count = ttf_u16(d + sub + 6);
+
+        // the 16 bit length overflows for big tables, use the pair count
+        U32 end = sub + 14 + 6*pair_count;
+        if(end > kern_length)
+            pair_count = (kern_length - sub - 14)/6;
+
+        // horizontal only, no minimum or cross stream values
+        if((coverage & 0x7) == 0x1)
+        {
+            *pairs = (TtfKernPair*)realloc(*pairs, (count + pair_count)*sizeof(TtfKernPair));
+
+            for(U32 i = 0; i < pair_count; ++i)
+            {
+                U8* p = d + sub + 14 + 6*i;
+
+                TtfKernPair* pair = &(*pairs)[count++];
+                pair->left = ttf_u16(p);
+                pair->right = ttf_u16(p + 2);
+                pair->value = ttf_i16(p + 4);
+            }
+        }
+
+        sub = end;
+    }
+
+    return count;
+}
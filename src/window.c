@@ -4,6 +4,15 @@
 
 #define TARGET_FPS 60.0f
 
+// headless rendering goes through a surfaceless EGL context (e.g. Mesa llvmpipe)
+#if PLATFORM == PLATFORM_UNIX
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#define WINDOW_HEADLESS_SUPPORTED 1
+#else
+#define WINDOW_HEADLESS_SUPPORTED 0
+#endif
+
 typedef enum
 {
     KEY_MODE_NONE,
@@ -39,6 +48,24 @@ static int text_buf_max = 0;
 static double window_coord_x = 0;
 static double window_coord_y = 0;
 
+static bool _damaged = false;
+
+// no window, rendering goes into an offscreen framebuffer
+static bool _headless = false;
+static bool _headless_close = false;
+
+#if WINDOW_HEADLESS_SUPPORTED
+static struct
+{
+    EGLDisplay display;
+    EGLContext context;
+    GLuint fbo;
+    GLuint rbo_color;
+    GLuint rbo_depth;
+    int width, height; // of the framebuffer
+} headless = {0};
+#endif
+
 static bool _has_scrolled = false;
 static double _scroll_x_offset = 0.0;
 static double _scroll_y_offset = 0.0;
@@ -48,6 +75,7 @@ static bool get_window_monitor(GLFWmonitor** monitor, GLFWwindow* window);
 static void window_size_callback(GLFWwindow* window, int _window_width, int _window_height);
 static void window_move_callback(GLFWwindow* window, int xpos, int ypos);
 static void window_maximize_callback(GLFWwindow* window, int maximized);
+static void window_refresh_callback(GLFWwindow* window);
 static void cursor_position_callback(GLFWwindow* window, double xpos, double ypos);
 static void char_callback(GLFWwindow* window, unsigned int code);
 static void key_callback(GLFWwindow* window, int key, int scan_code, int action, int mods);
@@ -90,6 +118,7 @@ bool window_init(int _view_width, int _view_height, bool maximized)
     glfwSetWindowSizeCallback(window,window_size_callback);
     glfwSetWindowPosCallback(window,window_move_callback);
     glfwSetWindowMaximizeCallback(window, window_maximize_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
     glfwSetKeyCallback(window, key_callback);
     glfwSetCharCallback(window, char_callback);
     glfwSetCursorPosCallback(window, cursor_position_callback);
@@ -133,6 +162,159 @@ bool window_init(int _view_width, int _view_height, bool maximized)
     return true;
 }
 
+// creates a GL context without a window or display, rendering into a
+// width x height framebuffer. The rest of the window API keeps working
+// as if the window never gets any input.
+bool window_init_headless(int width, int height)
+{
+#if WINDOW_HEADLESS_SUPPORTED
+    printf("Initializing headless EGL context.\n");
+
+    view_width = width;
+    view_height = height;
+
+    window_width = view_width;
+    window_height = view_height;
+
+    PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if(!get_platform_display)
+    {
+        fprintf(stderr, "EGL_EXT_platform_base is not supported!\n");
+        return false;
+    }
+
+    headless.display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+
+    EGLint major, minor;
+    if(headless.display == EGL_NO_DISPLAY || !eglInitialize(headless.display, &major, &minor))
+    {
+        fprintf(stderr, "Failed to initialize surfaceless EGL display!\n");
+        return false;
+    }
+
+    printf("EGL version: %d.%d\n", major, minor);
+
+    if(!eglBindAPI(EGL_OPENGL_API))
+    {
+        fprintf(stderr, "Failed to bind the OpenGL API!\n");
+        eglTerminate(headless.display);
+        return false;
+    }
+
+    EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+
+    headless.context = eglCreateContext(headless.display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, context_attribs);
+
+    if(headless.context == EGL_NO_CONTEXT || !eglMakeCurrent(headless.display, EGL_NO_SURFACE, EGL_NO_SURFACE, headless.context))
+    {
+        fprintf(stderr, "Failed to create headless OpenGL 3.3 context!\n");
+        eglTerminate(headless.display);
+        return false;
+    }
+
+    printf("Initializing GLEW.\n");
+
+    // GLEW loads the core entry points before looking for a GLX display,
+    // which a surfaceless context doesn't have
+    glewExperimental = 1;
+    GLenum glew_result = glewInit();
+    if(glew_result != GLEW_OK && glew_result != GLEW_ERROR_NO_GLX_DISPLAY)
+    {
+        fprintf(stderr, "Failed to initialize GLEW\n");
+        return false;
+    }
+
+    glGenFramebuffers(1, &headless.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, headless.fbo);
+
+    glGenRenderbuffers(1, &headless.rbo_color);
+    glBindRenderbuffer(GL_RENDERBUFFER, headless.rbo_color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, headless.rbo_color);
+
+    glGenRenderbuffers(1, &headless.rbo_depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, headless.rbo_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, headless.rbo_depth);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    if(glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        fprintf(stderr, "Headless framebuffer is incomplete!\n");
+        return false;
+    }
+
+    glViewport(0, 0, width, height);
+
+    headless.width = width;
+    headless.height = height;
+
+    mouse_left.action = GLFW_RELEASE;
+    mouse_right.action = GLFW_RELEASE;
+
+    _headless = true;
+    _headless_close = false;
+
+    return true;
+#else
+    fprintf(stderr, "Headless mode is not supported on this platform!\n");
+    return false;
+#endif
+}
+
+bool window_is_headless()
+{
+    return _headless;
+}
+
+// writes the headless framebuffer as a binary PPM. A window's back buffer
+// is undefined once it's been swapped, so there's nothing to dump there
+bool window_dump_framebuffer(const char* path)
+{
+#if WINDOW_HEADLESS_SUPPORTED
+    if(!_headless)
+    {
+        fprintf(stderr, "Only headless framebuffers can be dumped\n");
+        return false;
+    }
+
+    FILE* fp = fopen(path, "wb");
+    if(!fp)
+    {
+        fprintf(stderr, "Failed to open %s for writing\n", path);
+        return false;
+    }
+
+    int w = headless.width;
+    int h = headless.height;
+
+    U8* pixels = (U8*)malloc(w*h*3);
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    // GL rows start at the bottom
+    fprintf(fp, "P6\n%d %d\n255\n", w, h);
+    for(int y = h-1; y >= 0; --y)
+        fwrite(pixels + y*w*3, 1, w*3, fp);
+
+    fclose(fp);
+    free(pixels);
+
+    printf("Dumped framebuffer to %s (%d x %d)\n", path, w, h);
+    return true;
+#else
+    fprintf(stderr, "Only headless framebuffers can be dumped\n");
+    return false;
+#endif
+}
 
 void window_get_mouse_coords(float* x, float* y)
 {
@@ -152,31 +334,69 @@ void window_set_mouse_view_coords(float x, float y)
 {
     double _x = (double)x / (view_width/(float)window_width);
     double _y = (double)y / (view_height/(float)window_height);
+
+    if(_headless)
+    {
+        window_coord_x = _x;
+        window_coord_y = _y;
+        return;
+    }
+
     glfwSetCursorPos(window, _x, _y);
 }
 
 void window_deinit()
 {
+#if WINDOW_HEADLESS_SUPPORTED
+    if(_headless)
+    {
+        glDeleteFramebuffers(1, &headless.fbo);
+        glDeleteRenderbuffers(1, &headless.rbo_color);
+        glDeleteRenderbuffers(1, &headless.rbo_depth);
+
+        eglMakeCurrent(headless.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(headless.display, headless.context);
+        eglTerminate(headless.display);
+        return;
+    }
+#endif
+
     glfwTerminate();
 }
 
 void window_poll_events()
 {
+    if(_headless)
+        return;
+
     glfwPollEvents();
 }
 
 bool window_should_close()
 {
+    if(_headless)
+        return _headless_close;
+
     return (glfwWindowShouldClose(window) != 0);
 }
 
 void window_set_close(int value)
 {
+    if(_headless)
+    {
+        _headless_close = (value != 0);
+        return;
+    }
+
     glfwSetWindowShouldClose(window,value);
 }
 
 void window_swap_buffers()
 {
+    // nothing to present, the frame stays in the framebuffer
+    if(_headless)
+        return;
+
     glfwSwapBuffers(window);
 }
 
@@ -238,11 +458,17 @@ void window_text_mode_buf_remove(int index, bool backspace)
 
 const char* window_get_clipboard()
 {
+    if(_headless)
+        return NULL;
+
     return glfwGetClipboardString(window);
 }
 
 void window_set_clipboard(const char* clip)
 {
+    if(_headless)
+        return;
+
     glfwSetClipboardString(window, clip);
 }
 
@@ -418,6 +644,19 @@ static void window_maximize_callback(GLFWwindow* window, int maximized)
     }
 }
 
+// contents of the window were lost (e.g. uncovered) and need to be redrawn
+static void window_refresh_callback(GLFWwindow* window)
+{
+    _damaged = true;
+}
+
+bool window_take_damage()
+{
+    bool damaged = _damaged;
+    _damaged = false;
+    return damaged;
+}
+
 static void cursor_position_callback(GLFWwindow* window, double xpos, double ypos)
 {
     window_coord_x = xpos;
@@ -442,6 +681,9 @@ static int window_mouse_buttons_count = 0;
 
 bool window_controls_is_key_state(int key, int state)
 {
+    if(_headless)
+        return state == GLFW_RELEASE;
+
     return glfwGetKey(window, key) == state;
 }
 
@@ -493,17 +735,26 @@ void window_controls_add_mouse_button(bool* state, int key)
 
 bool window_is_cursor_enabled()
 {
+    if(_headless)
+        return true;
+
     int mode = glfwGetInputMode(window,GLFW_CURSOR);
     return (mode == GLFW_CURSOR_NORMAL);
 }
 
 void window_enable_cursor()
 {
+    if(_headless)
+        return;
+
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
 }
 
 void window_disable_cursor()
 {
+    if(_headless)
+        return;
+
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 }
 
@@ -593,11 +844,17 @@ bool window_mouse_left_went_up()
 
 void window_mouse_set_cursor_ibeam()
 {
+    if(_headless)
+        return;
+
     glfwSetCursor(window,cursor_ibeam);
 }
 
 void window_mouse_set_cursor_normal()
 {
+    if(_headless)
+        return;
+
     glfwSetCursor(window,NULL); // standard
 }
 